@@ -0,0 +1,369 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Update pipeline benchmark: synthetic commands of various output sizes
+ *  and latencies are run through the applet command machinery, and their
+ *  output is displayed in an offscreen label when a display is available
+ *  (e.g.: xvfb-run). Per-update latency, main loop stalls and heap growth
+ *  are reported, and checked against bounds meant to catch gross
+ *  regressions.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_MALLOC_H
+#include <malloc.h>
+#endif
+#include <gtk/gtk.h>
+#include <glib.h>
+
+#include "command.h"
+#include "run.h"
+#include "label.h"
+#include "stats.h"
+
+
+#define STALL_TICK	1		/* Main loop probe period (ms). */
+#define BENCH_SKIP	77		/* Test harness "skipped" status. */
+#define MAX_LATENCY	2000		/* Default 95% latency bound (ms). */
+#define MAX_STALL	1000		/* Default stall bound (ms). */
+#define MAX_HEAP	16384		/* Default heap growth bound (bytes). */
+
+
+/*
+ * A benchmark scenario.
+ */
+typedef struct {
+	guint			size;		/* Output size (bytes). */
+	guint			delay;		/* Command latency (ms). */
+}		scenario_t;
+
+static const scenario_t	scenarios[] = {
+	{	16,		0	},
+	{	1024,		0	},
+	{	65536,		0	},
+	{	1048576,	0	},
+	{	16,		20	},
+	{	1024,		100	},
+};
+
+/*
+ * Benchmark state.
+ */
+static struct {
+	GMainLoop *		loop;
+	GtkWidget *		label;		/* Offscreen label or NULL. */
+	compa_label_t		cache;		/* Displayed label text. */
+	compa_stats_t		stats;
+	gchar *			command;	/* Current scenario command. */
+	gint			updates;	/* Updates per scenario. */
+	gsize			limit;		/* Output limit (bytes). */
+	GArray *		latencies;	/* Update latencies (usec). */
+	gint64			probe;		/* Last stall probe time. */
+	gint64			stall_max;	/* Max. main loop stall (usec). */
+	gint64			stall_total;	/* Total main loop stall. */
+	gint			max_latency;	/* Bounds, 0 if unchecked. */
+	gint			max_stall;
+	gint			max_heap;
+}		bench;
+
+
+/*
+ *  Heap bytes in use, or 0 if unknown.
+ */
+static guint64
+heap_used(void)
+{
+#ifdef HAVE_MALLINFO2
+	return mallinfo2().uordblks;
+#else
+	return 0;
+#endif
+}
+
+
+/*
+ *  Main loop probe: measure how late it gets dispatched.
+ */
+static gboolean
+stall_probe(gpointer user_data)
+{
+	gint64 now = g_get_monotonic_time();
+	gint64 stall = now - bench.probe - STALL_TICK * 1000;
+
+	(void) user_data;
+
+	if (stall > 0) {
+		bench.stall_total += stall;
+		if (stall > bench.stall_max)
+			bench.stall_max = stall;
+	}
+
+	bench.probe = now;
+	return G_SOURCE_CONTINUE;
+}
+
+
+static void	update_done(compa_run_t *run);
+
+
+/*
+ *  Start an update.
+ */
+static void
+update_start(void)
+{
+	if (!run_start(&bench, &bench.stats, bench.limit, bench.command,
+		       NULL, FALSE, update_done)) {
+		fprintf(stderr, "Cannot spawn command\n");
+		g_main_loop_quit(bench.loop);
+	}
+}
+
+
+/*
+ *  An update command has completed: display its output and run the next
+ *   one.
+ */
+static void
+update_done(compa_run_t *run)
+{
+	GtkRequisition size;
+	gint64 latency;
+
+	/* Display and lay the label out as the panel would. */
+	if (bench.label &&
+	    label_show(bench.label, &bench.cache, run->output->str, FALSE))
+		gtk_widget_get_preferred_size(bench.label, NULL, &size);
+
+	latency = g_get_monotonic_time() - run->start;
+	g_array_append_val(bench.latencies, latency);
+
+	if (bench.latencies->len < (guint) bench.updates)
+		update_start();
+	else
+		g_main_loop_quit(bench.loop);
+}
+
+
+/*
+ *  Latency comparison for sorting.
+ */
+static gint
+latency_compare(gconstpointer a, gconstpointer b)
+{
+	gint64 x = *(const gint64 *) a;
+	gint64 y = *(const gint64 *) b;
+
+	return x < y? -1: x > y;
+}
+
+
+/*
+ *  Check a scenario result against its bound. Return FALSE if exceeded.
+ */
+static gboolean
+bench_check(const scenario_t *s, const gchar *what, gdouble value, gint max)
+{
+	if (!max || value <= max)
+		return TRUE;
+
+	printf("FAIL %u bytes, %u ms: %s %.3f exceeds %d\n",
+	       s->size, s->delay, what, value, max);
+	return FALSE;
+}
+
+
+/*
+ *  Run a scenario and report its results. Return FALSE if a bound is
+ *   exceeded.
+ */
+static gboolean
+scenario_run(const scenario_t *s)
+{
+	gboolean ok = TRUE;
+	gint64 *l;
+	gint64 total = 0;
+	gint64 heap;
+	guint n;
+	guint i;
+	guint source;
+
+	if (s->delay)
+		bench.command = g_strdup_printf("sleep %u.%03u; "
+						"head -c %u /dev/zero | "
+						"tr '\\0' x",
+						s->delay / 1000,
+						s->delay % 1000, s->size);
+	else
+		bench.command = g_strdup_printf("head -c %u /dev/zero | "
+						"tr '\\0' x", s->size);
+
+	bench.latencies = g_array_sized_new(FALSE, FALSE, sizeof(gint64),
+					    bench.updates);
+	bench.stall_max = 0;
+	bench.stall_total = 0;
+	label_forget(&bench.cache);
+
+	heap = (gint64) heap_used();
+	bench.probe = g_get_monotonic_time();
+	source = g_timeout_add(STALL_TICK, stall_probe, NULL);
+	update_start();
+	g_main_loop_run(bench.loop);
+	g_source_remove(source);
+	heap = (gint64) heap_used() - heap;	/* May shrink. */
+
+	n = bench.latencies->len;
+	l = (gint64 *) bench.latencies->data;
+	g_array_sort(bench.latencies, latency_compare);
+	for (i = 0; i < n; i++)
+		total += l[i];
+
+	if (n) {
+		printf("%9u %7u %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %10"
+		       G_GINT64_FORMAT "\n", s->size, s->delay,
+		       total / 1000.0 / n, l[n / 2] / 1000.0,
+		       l[n * 95 / 100] / 1000.0, l[n - 1] / 1000.0,
+		       bench.stall_max / 1000.0,
+		       bench.stall_total / 1000.0 / n,
+		       heap / (gint64) n);
+
+		/* The command own delay is not ours. */
+		ok &= bench_check(s, "95% latency (ms)",
+				  l[n * 95 / 100] / 1000.0 - s->delay,
+				  bench.max_latency);
+		ok &= bench_check(s, "stall (ms)", bench.stall_max / 1000.0,
+				  bench.max_stall);
+		ok &= bench_check(s, "heap growth per update (bytes)",
+				  (gdouble) heap / n, bench.max_heap);
+	}
+
+	g_array_free(bench.latencies, TRUE);
+	g_free(bench.command);
+	return ok;
+}
+
+
+int
+main(int argc, char **argv)
+{
+	gboolean helper = FALSE;
+	gint limit = 64;
+	GError *error = NULL;
+	GOptionContext *context;
+	GtkWidget *window = NULL;
+	GtkRequisition size;
+	gboolean ok = TRUE;
+	gsize i;
+	const GOptionEntry options[] = {
+		{
+			"updates", 'n', 0, G_OPTION_ARG_INT, &bench.updates,
+			"Updates per scenario (default 200)", "N"
+		},
+		{
+			"limit", 'l', 0, G_OPTION_ARG_INT, &limit,
+			"Output limit (default 64)", "KIB"
+		},
+		{
+			"helper", 's', 0, G_OPTION_ARG_NONE, &helper,
+			"Spawn through the installed spawn helper", NULL
+		},
+		{
+			"max-latency", 0, 0, G_OPTION_ARG_INT,
+			&bench.max_latency,
+			"95% latency bound, command delay excluded "
+			"(default 2000, 0 for none)", "MS"
+		},
+		{
+			"max-stall", 0, 0, G_OPTION_ARG_INT, &bench.max_stall,
+			"Main loop stall bound (default 1000, 0 for none)",
+			"MS"
+		},
+		{
+			"max-heap", 0, 0, G_OPTION_ARG_INT, &bench.max_heap,
+			"Heap growth per update bound (default 16384, "
+			"0 for none)", "BYTES"
+		},
+		{ NULL }
+	};
+
+	bench.updates = 200;
+	bench.max_latency = MAX_LATENCY;
+	bench.max_stall = MAX_STALL;
+	bench.max_heap = MAX_HEAP;
+	context = g_option_context_new("- compa update pipeline benchmark");
+	g_option_context_add_main_entries(context, options, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		fprintf(stderr, "%s\n", error->message);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	if (bench.updates <= 0 || limit <= 0 || bench.max_latency < 0 ||
+	    bench.max_stall < 0 || bench.max_heap < 0) {
+		fprintf(stderr, "Invalid option value\n");
+		return 1;
+	}
+
+	bench.limit = (gsize) limit * 1024;
+	bench.loop = g_main_loop_new(NULL, FALSE);
+
+	if (helper)
+		helper_start();
+
+	/* Display output offscreen if possible. */
+	if (gtk_init_check(&argc, &argv)) {
+		window = gtk_offscreen_window_new();
+		bench.label = gtk_label_new(NULL);
+		gtk_container_add(GTK_CONTAINER(window), bench.label);
+		gtk_widget_show_all(window);
+
+		/* Load fonts before measuring heap growth. */
+		gtk_label_set_text(GTK_LABEL(bench.label), "x");
+		gtk_widget_get_preferred_size(bench.label, NULL, &size);
+	}
+	else
+		printf("No display: label updates are not measured\n");
+
+	printf("%9s %7s %9s %9s %9s %9s %9s %9s %10s\n", "Size", "Delay",
+	       "Mean", "Median", "95%", "Max", "Stall", "Stall/u",
+	       "Heap/u");
+	printf("%9s %7s %9s %9s %9s %9s %9s %9s %10s\n", "(bytes)", "(ms)",
+	       "(ms)", "(ms)", "(ms)", "(ms)", "(ms)", "(ms)", "(bytes)");
+
+	for (i = 0; i < G_N_ELEMENTS(scenarios); i++)
+		ok &= scenario_run(scenarios + i);
+
+	printf("Spawns %" G_GUINT64_FORMAT ", failures %" G_GUINT64_FORMAT
+	       ", bytes read %" G_GUINT64_FORMAT "\n", bench.stats.spawns,
+	       bench.stats.failures, bench.stats.bytes);
+
+	label_forget(&bench.cache);
+	if (window)
+		gtk_widget_destroy(window);
+	g_main_loop_unref(bench.loop);
+
+	/* No command could be run at all: report as skipped. */
+	if (bench.stats.failures && bench.stats.failures == bench.stats.spawns)
+		return BENCH_SKIP;
+	return bench.stats.failures || !ok? 1: 0;
+}
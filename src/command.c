@@ -0,0 +1,490 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <glib.h>
+#include <glib-unix.h>
+
+#include "config.h"
+#include "helper.h"
+#include "command.h"
+
+
+/* Characters requiring a command to be interpreted by the shell. */
+#define SHELL_METACHARS	"|&;<>()$`*?[#~\n"
+
+/* Helper reply timeout (ms): beyond, the helper is considered stuck. */
+#define HELPER_TIMEOUT	2000
+
+
+/*
+ *  Tokenize a command for direct execution. Return NULL if the command
+ *   has to be interpreted by the shell.
+ */
+gchar **
+command_argv(const gchar *command)
+{
+	gchar **argv;
+	gchar *path;
+
+	if (!command || strpbrk(command, SHELL_METACHARS))
+		return NULL;
+
+	if (!g_shell_parse_argv(command, NULL, &argv, NULL))
+		return NULL;
+
+	/* Variable assignments and shell builtins need the shell. */
+	path = strchr(argv[0], '=')? NULL: g_find_program_in_path(argv[0]);
+	if (!path) {
+		g_strfreev(argv);
+		return NULL;
+	}
+
+	/* Avoid searching the path at each execution. */
+	g_free(argv[0]);
+	argv[0] = path;
+	return argv;
+}
+
+
+/*
+ * Spawn helper: a single one is shared by all the applet instances of the
+ *  factory process.
+ */
+typedef struct {
+	GPid			pid;
+	gboolean		collected;	/* Output read by the applet. */
+	GChildWatchFunc		exited;
+	gpointer		data;
+}		helper_watch_t;
+
+static struct {
+	gint			fd;		/* Helper socket or -1. */
+	guint			watch;		/* Socket watch source. */
+	guint32			last_id;	/* Last request id. */
+	GHashTable *		watches;	/* Exit watches by request id. */
+	GArray *		exits;		/* Exits received while spawning. */
+	guint			exits_idle;	/* Deferred exits source. */
+}		helper = { -1 };
+
+
+/*
+ *  Receive a message from the helper, with its file descriptors. Return
+ *   1 if received, 0 if none is available without waiting or -1 if the
+ *   helper has gone or does not answer in time.
+ */
+static gint
+helper_receive(helper_reply_t *r, gint *fds, gint *nfds, gboolean wait)
+{
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr *c;
+	union {
+		struct cmsghdr	hdr;
+		char		buf[CMSG_SPACE(2 * sizeof(int))];
+	}		control;
+	ssize_t len;
+
+	iov.iov_base = r;
+	iov.iov_len = sizeof *r;
+	memset(&msg, 0, sizeof msg);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof control.buf;
+
+	/* Do not freeze the panel on a stuck helper. */
+	if (wait) {
+		struct pollfd pfd;
+		gint n;
+
+		pfd.fd = helper.fd;
+		pfd.events = POLLIN;
+		do
+			n = poll(&pfd, 1, HELPER_TIMEOUT);
+		while (n < 0 && errno == EINTR);
+		if (n <= 0)
+			return -1;
+	}
+
+	do
+		len = recvmsg(helper.fd, &msg, MSG_CMSG_CLOEXEC |
+						(wait? 0: MSG_DONTWAIT));
+	while (len < 0 && errno == EINTR);
+
+	if (len < 0 && !wait && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return 0;
+
+	if (len != sizeof *r)
+		return -1;
+
+	*nfds = 0;
+	for (c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c))
+		if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+			*nfds = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			memcpy(fds, CMSG_DATA(c), *nfds * sizeof(int));
+		}
+
+	return 1;
+}
+
+
+/*
+ *  Dispatch a child termination reported by the helper.
+ */
+static void
+helper_exited(guint32 id, gint status)
+{
+	helper_watch_t *w = g_hash_table_lookup(helper.watches,
+						GUINT_TO_POINTER(id));
+
+	if (w) {
+		g_hash_table_steal(helper.watches, GUINT_TO_POINTER(id));
+		w->exited(w->pid, status, w->data);
+		g_free(w);
+	}
+}
+
+
+/*
+ *  Dispatch terminations received while waiting for a spawn reply.
+ */
+static gboolean
+helper_deferred_exits(gpointer user_data)
+{
+	(void) user_data;
+
+	helper.exits_idle = 0;
+	while (helper.exits->len) {
+		helper_reply_t r = g_array_index(helper.exits,
+						 helper_reply_t, 0);
+
+		g_array_remove_index(helper.exits, 0);
+		helper_exited(r.id, r.value);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+
+/*
+ *  Helper has gone or is stuck: spawn directly from now on. Pending
+ *   children will never be reported, so terminate their watches. Commands
+ *   whose output the applet reads are terminated too, detached ones (e.g.:
+ *   click commands) are left running.
+ */
+static void
+helper_stop(void)
+{
+	GHashTableIter iter;
+	gpointer id;
+	helper_watch_t *w;
+
+	if (helper.fd < 0)
+		return;
+
+	if (helper.watch)
+		g_source_remove(helper.watch);
+	helper.watch = 0;
+	close(helper.fd);
+	helper.fd = -1;
+
+	g_hash_table_iter_init(&iter, helper.watches);
+	while (g_hash_table_iter_next(&iter, &id, (gpointer *) &w)) {
+		/* Each command leads its own process group. */
+		if (w->collected && w->pid > 0)
+			kill(-w->pid, SIGTERM);
+		g_array_append_vals(helper.exits,
+				    &(helper_reply_t) {
+					HELPER_EXITED, GPOINTER_TO_UINT(id),
+					255 << 8
+				    }, 1);
+	}
+
+	if (!helper.exits_idle && helper.exits->len)
+		helper.exits_idle = g_idle_add(helper_deferred_exits, NULL);
+}
+
+
+/*
+ *  Helper socket input.
+ */
+static gboolean
+helper_input(GIOChannel *channel, GIOCondition condition, gpointer user_data)
+{
+	helper_reply_t r;
+	gint fds[2];
+	gint nfds;
+
+	(void) channel;
+	(void) condition;
+	(void) user_data;
+
+	/* A spawn request may have already consumed the message. */
+	switch (helper_receive(&r, fds, &nfds, FALSE)) {
+	case 0:
+		return G_SOURCE_CONTINUE;
+	case -1:
+		helper.watch = 0;
+		helper_stop();
+		return G_SOURCE_REMOVE;
+	}
+
+	while (nfds)
+		close(fds[--nfds]);	/* Unexpected. */
+
+	if (r.type == HELPER_EXITED)
+		helper_exited(r.id, r.value);
+
+	return G_SOURCE_CONTINUE;
+}
+
+
+/*
+ *  Helper child process setup: move the socket to its expected place.
+ */
+static void
+helper_child_setup(gpointer user_data)
+{
+	gint fd = GPOINTER_TO_INT(user_data);
+
+	if (fd == HELPER_FD)
+		fcntl(fd, F_SETFD, 0);
+	else
+		dup2(fd, HELPER_FD);
+}
+
+
+/*
+ *  Helper process exited.
+ */
+static void
+helper_reap(GPid pid, gint status, gpointer user_data)
+{
+	(void) status;
+	(void) user_data;
+
+	g_spawn_close_pid(pid);
+}
+
+
+/*
+ *  Start the spawn helper if not yet running. In case of failure,
+ *   commands are spawned directly by the applet process.
+ */
+void
+helper_start(void)
+{
+	gchar *argv[] = { PANELLIBEXECDIR "/" HELPER_NAME, NULL };
+	GIOChannel *channel;
+	GPid pid;
+	gint sv[2];
+
+	if (helper.fd >= 0)
+		return;
+
+	if (!helper.watches) {
+		helper.watches = g_hash_table_new_full(NULL, NULL,
+						       NULL, g_free);
+		helper.exits = g_array_new(FALSE, FALSE,
+					   sizeof(helper_reply_t));
+	}
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv))
+		return;
+
+	if (!g_spawn_async(NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD,
+			   helper_child_setup, GINT_TO_POINTER(sv[1]),
+			   &pid, NULL)) {
+		close(sv[0]);
+		close(sv[1]);
+		return;
+	}
+
+	close(sv[1]);
+	g_child_watch_add(pid, helper_reap, NULL);
+	helper.fd = sv[0];
+	channel = g_io_channel_unix_new(helper.fd);
+	helper.watch = g_io_add_watch(channel, G_IO_IN | G_IO_HUP | G_IO_ERR,
+				      helper_input, NULL);
+	g_io_channel_unref(channel);
+}
+
+
+/*
+ *  Spawn a command through the helper. The spawn reply is waited for
+ *   synchronously: it comes as soon as the command has been executed.
+ *   If it does not, the caller spawns the command directly.
+ */
+static gboolean
+helper_spawn(gchar **argv, GPid *pid, gint *in, gint *out,
+	     GChildWatchFunc exited, gpointer data)
+{
+	helper_request_t req;
+	helper_reply_t r;
+	helper_watch_t *w;
+	GByteArray *msg;
+	gint fds[2];
+	gint nfds;
+	gint i;
+	ssize_t len;
+
+	req.type = HELPER_SPAWN;
+	req.id = ++helper.last_id? helper.last_id: ++helper.last_id;
+	req.flags = (in? HELPER_STDIN: 0) | (out? HELPER_STDOUT: 0);
+	msg = g_byte_array_new();
+	g_byte_array_append(msg, (guint8 *) &req, sizeof req);
+	for (i = 0; argv[i]; i++)
+		g_byte_array_append(msg, (guint8 *) argv[i],
+				    strlen(argv[i]) + 1);
+
+	do
+		len = send(helper.fd, msg->data, msg->len, MSG_NOSIGNAL);
+	while (len < 0 && errno == EINTR);
+	g_byte_array_free(msg, TRUE);
+
+	if (len < 0) {
+		helper_stop();
+		return FALSE;
+	}
+
+	for (;;) {
+		if (helper_receive(&r, fds, &nfds, TRUE) < 0) {
+			helper_stop();
+			return FALSE;
+		}
+
+		if (r.id == req.id)
+			break;
+
+		while (nfds)
+			close(fds[--nfds]);
+
+		if (r.type == HELPER_EXITED) {
+			/* Avoid reentrance: dispatch it later. */
+			g_array_append_val(helper.exits, r);
+			if (!helper.exits_idle)
+				helper.exits_idle =
+				    g_idle_add(helper_deferred_exits, NULL);
+		}
+	}
+
+	if (r.type != HELPER_SPAWNED ||
+	    nfds != (in? 1: 0) + (out? 1: 0)) {
+		while (nfds)
+			close(fds[--nfds]);
+		return FALSE;
+	}
+
+	nfds = 0;
+	if (out)
+		*out = fds[nfds++];
+	if (in)
+		*in = fds[nfds++];
+
+	*pid = r.value;
+	w = g_new(helper_watch_t, 1);
+	w->pid = r.value;
+	w->collected = out != NULL;
+	w->exited = exited;
+	w->data = data;
+	g_hash_table_insert(helper.watches, GUINT_TO_POINTER(req.id), w);
+	return TRUE;
+}
+
+
+/*
+ *  Spawned command setup: lead a new process group.
+ */
+static void
+command_child_setup(gpointer user_data)
+{
+	(void) user_data;
+
+	setpgid(0, 0);
+}
+
+
+/*
+ *  Send a signal to a spawned command and its descendants: each command
+ *   leads its own process group.
+ */
+void
+command_kill(GPid pid, gint sig)
+{
+	GHashTableIter iter;
+	gpointer id;
+	helper_watch_t *w;
+
+	if (helper.watches) {
+		g_hash_table_iter_init(&iter, helper.watches);
+		while (g_hash_table_iter_next(&iter, &id, (gpointer *) &w))
+			if (w->pid == pid) {
+				helper_request_t req;
+
+				/* Signal it through its parent. */
+				req.type = HELPER_SIGNAL;
+				req.id = GPOINTER_TO_UINT(id);
+				req.flags = sig;
+				if (helper.fd >= 0 &&
+				    send(helper.fd, &req, sizeof req,
+					 MSG_NOSIGNAL) == sizeof req)
+					return;
+				break;
+			}
+	}
+
+	kill(-pid, sig);
+}
+
+
+/*
+ *  Spawn a command without waiting for it. `exited' is called upon
+ *   command termination.
+ */
+gboolean
+command_spawn(const gchar *command, gchar **argv, GPid *pid,
+	      gint *in, gint *out, GChildWatchFunc exited, gpointer data)
+{
+	gchar *shell[] = { "/bin/sh", "-c", (gchar *) command, NULL };
+
+	if (!argv)
+		argv = shell;
+
+	if (helper.fd >= 0 &&
+	    helper_spawn(argv, pid, in, out, exited, data))
+		return TRUE;
+
+	/* No helper: fork the applet process. */
+	if (!g_spawn_async_with_pipes(NULL, argv, NULL,
+				      G_SPAWN_DO_NOT_REAP_CHILD |
+				      G_SPAWN_CLOEXEC_PIPES,
+				      command_child_setup, NULL,
+				      pid, in, out, NULL, NULL))
+		return FALSE;
+
+	g_child_watch_add(*pid, exited, data);
+	return TRUE;
+}
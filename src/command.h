@@ -0,0 +1,35 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Command spawning, through the spawn helper when available.
+ */
+
+#ifndef COMPA_COMMAND_H
+#define COMPA_COMMAND_H
+
+#include <glib.h>
+
+extern gchar **	command_argv(const gchar *command);
+extern void	helper_start(void);
+extern void	command_kill(GPid pid, gint sig);
+extern gboolean	command_spawn(const gchar *command, gchar **argv, GPid *pid,
+			      gint *in, gint *out, GChildWatchFunc exited,
+			      gpointer data);
+
+#endif
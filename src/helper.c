@@ -0,0 +1,383 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Spawn helper: a tiny process started once by the applet factory. It
+ *  forks and executes commands on behalf of the applet, so that the spawn
+ *  cost does not depend on the applet memory footprint.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#include "helper.h"
+
+
+typedef struct {
+	pid_t			pid;
+	uint32_t		id;
+}		child_t;
+
+
+static child_t *	children;	/* Running children. */
+static size_t		nchildren;	/* Running children count. */
+static size_t		maxchildren;	/* Children table size. */
+static int		sigchld_pipe[2]; /* SIGCHLD self-pipe. */
+
+
+/*
+ *  SIGCHLD handler: wake up the main loop.
+ */
+static void
+sigchld(int sig)
+{
+	int e = errno;
+
+	(void) sig;
+
+	if (write(sigchld_pipe[1], "", 1) < 0)
+		;			/* Already signaled. */
+
+	errno = e;
+}
+
+
+/*
+ *  Send a reply, with optional file descriptors.
+ */
+static void
+reply(int sock, uint32_t type, uint32_t id, int32_t value,
+      const int *fds, int nfds)
+{
+	helper_reply_t r;
+	struct iovec iov;
+	struct msghdr msg;
+	struct cmsghdr *c;
+	union {
+		struct cmsghdr	hdr;
+		char		buf[CMSG_SPACE(2 * sizeof(int))];
+	}		control;
+
+	r.type = type;
+	r.id = id;
+	r.value = value;
+	iov.iov_base = &r;
+	iov.iov_len = sizeof r;
+	memset(&msg, 0, sizeof msg);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if (nfds) {
+		memset(&control, 0, sizeof control);
+		msg.msg_control = control.buf;
+		msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+		c = CMSG_FIRSTHDR(&msg);
+		c->cmsg_level = SOL_SOCKET;
+		c->cmsg_type = SCM_RIGHTS;
+		c->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+		memcpy(CMSG_DATA(c), fds, nfds * sizeof(int));
+	}
+
+	while (sendmsg(sock, &msg, MSG_NOSIGNAL) < 0 && errno == EINTR)
+		;
+}
+
+
+/*
+ *  Close a pipe.
+ */
+static void
+close_pipe(int *fds)
+{
+	if (fds[0] >= 0)
+		close(fds[0]);
+	if (fds[1] >= 0)
+		close(fds[1]);
+	fds[0] = fds[1] = -1;
+}
+
+
+/*
+ *  Spawn a command.
+ */
+static void
+spawn(int sock, const helper_request_t *req, char *data, size_t len)
+{
+	int out[2] = { -1, -1 };
+	int in[2] = { -1, -1 };
+	int status[2] = { -1, -1 };
+	char **argv;
+	size_t argc;
+	size_t i;
+	pid_t pid;
+	int err;
+	int fds[2];
+	int nfds;
+
+	/* Split NUL-terminated arguments. */
+	if (!len || data[len - 1]) {
+		reply(sock, HELPER_FAILED, req->id, EINVAL, NULL, 0);
+		return;
+	}
+
+	for (argc = i = 0; i < len; i++)
+		if (!data[i])
+			argc++;
+
+	argv = malloc((argc + 1) * sizeof *argv);
+	if (!argv) {
+		reply(sock, HELPER_FAILED, req->id, ENOMEM, NULL, 0);
+		return;
+	}
+
+	for (argc = i = 0; i < len; i += strlen(data + i) + 1)
+		argv[argc++] = data + i;
+	argv[argc] = NULL;
+
+	if (nchildren >= maxchildren) {
+		child_t *t = realloc(children,
+				     (maxchildren + 16) * sizeof *children);
+
+		if (!t) {
+			free(argv);
+			reply(sock, HELPER_FAILED, req->id, ENOMEM, NULL, 0);
+			return;
+		}
+
+		children = t;
+		maxchildren += 16;
+	}
+
+	if (pipe2(status, O_CLOEXEC) ||
+	    ((req->flags & HELPER_STDOUT) && pipe2(out, O_CLOEXEC)) ||
+	    ((req->flags & HELPER_STDIN) && pipe2(in, O_CLOEXEC))) {
+		err = errno;
+		close_pipe(out);
+		close_pipe(in);
+		close_pipe(status);
+		free(argv);
+		reply(sock, HELPER_FAILED, req->id, err, NULL, 0);
+		return;
+	}
+
+	pid = fork();
+
+	if (!pid) {
+		/* Child: lead a new process group so that the whole command
+		   can be signalled, restore signals and redirect standard
+		   files. */
+		setpgid(0, 0);
+		signal(SIGPIPE, SIG_DFL);
+		signal(SIGCHLD, SIG_DFL);
+		if (in[0] >= 0)
+			dup2(in[0], 0);
+		if (out[1] >= 0)
+			dup2(out[1], 1);
+		execv(argv[0], argv);
+
+		/* Report exec failure to parent. */
+		err = errno;
+		if (write(status[1], &err, sizeof err) < 0)
+			;
+		_exit(127);
+	}
+
+	err = errno;
+	free(argv);
+	close(status[1]);
+	if (out[1] >= 0)
+		close(out[1]);
+	if (in[0] >= 0)
+		close(in[0]);
+
+	if (pid > 0) {
+		ssize_t n;
+
+		/* The status pipe is closed by a successful exec. */
+		do
+			n = read(status[0], &err, sizeof err);
+		while (n < 0 && errno == EINTR);
+
+		if (n != sizeof err)
+			err = 0;
+		/* Else the failed child is reaped as an unknown process. */
+	}
+
+	close(status[0]);
+
+	if (pid < 0 || err) {
+		if (out[0] >= 0)
+			close(out[0]);
+		if (in[1] >= 0)
+			close(in[1]);
+		reply(sock, HELPER_FAILED, req->id, err, NULL, 0);
+		return;
+	}
+
+	children[nchildren].pid = pid;
+	children[nchildren].id = req->id;
+	nchildren++;
+
+	nfds = 0;
+	if (out[0] >= 0)
+		fds[nfds++] = out[0];
+	if (in[1] >= 0)
+		fds[nfds++] = in[1];
+	reply(sock, HELPER_SPAWNED, req->id, pid, fds, nfds);
+
+	if (out[0] >= 0)
+		close(out[0]);
+	if (in[1] >= 0)
+		close(in[1]);
+}
+
+
+/*
+ *  Signal a child process group.
+ */
+static void
+signal_child(const helper_request_t *req)
+{
+	size_t i;
+
+	for (i = 0; i < nchildren; i++)
+		if (children[i].id == req->id) {
+			kill(-children[i].pid, req->flags);
+			break;
+		}
+}
+
+
+/*
+ *  Reap terminated children and report them.
+ */
+static void
+reap(int sock)
+{
+	pid_t pid;
+	int status;
+	size_t i;
+
+	while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+		for (i = 0; i < nchildren; i++)
+			if (children[i].pid == pid) {
+				reply(sock, HELPER_EXITED, children[i].id,
+				      status, NULL, 0);
+				children[i] = children[--nchildren];
+				break;
+			}
+}
+
+
+/*
+ *  Process a request. Return 0 if the applet has gone.
+ */
+static int
+request(int sock)
+{
+	static char buf[sizeof(helper_request_t) + HELPER_MAX_DATA];
+	helper_request_t req;
+	ssize_t len;
+
+	len = recv(sock, buf, sizeof buf, MSG_TRUNC);
+
+	if (len < 0)
+		return errno == EINTR || errno == EAGAIN;
+
+	if (!len)
+		return 0;		/* Applet closed its end. */
+
+	if ((size_t) len < sizeof req)
+		return 1;		/* Ignore garbage. */
+
+	memcpy(&req, buf, sizeof req);
+
+	switch (req.type) {
+	case HELPER_SPAWN:
+		if ((size_t) len > sizeof buf)
+			reply(sock, HELPER_FAILED, req.id, E2BIG, NULL, 0);
+		else
+			spawn(sock, &req, buf + sizeof req, len - sizeof req);
+		break;
+
+	case HELPER_SIGNAL:
+		signal_child(&req);
+		break;
+	}
+
+	return 1;
+}
+
+
+int
+main(int argc, char **argv)
+{
+	int sock = HELPER_FD;
+	struct sigaction sa;
+	struct pollfd pfd[2];
+	char c[64];
+
+	(void) argc;
+	(void) argv;
+
+	if (pipe2(sigchld_pipe, O_CLOEXEC | O_NONBLOCK))
+		return 1;
+
+	fcntl(sock, F_SETFD, FD_CLOEXEC);
+	signal(SIGPIPE, SIG_IGN);
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = sigchld;
+	sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGCHLD, &sa, NULL);
+
+	pfd[0].fd = sock;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = sigchld_pipe[0];
+	pfd[1].events = POLLIN;
+
+	for (;;) {
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (pfd[1].revents) {
+			while (read(sigchld_pipe[0], c, sizeof c) > 0)
+				;
+			reap(sock);
+		}
+
+		if (pfd[0].revents && !request(sock))
+			break;
+	}
+
+	return 0;
+}
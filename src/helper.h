@@ -0,0 +1,64 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Spawn helper protocol.
+ *
+ * The applet and the helper exchange datagrams over a SOCK_SEQPACKET
+ *  socket pair. A spawn request is followed by the NUL-terminated
+ *  arguments of the command to execute, the first one being the program
+ *  path. Once the command is started, the helper returns the requested
+ *  standard output and standard input pipes, in this order, as SCM_RIGHTS
+ *  ancillary data, then reports the process termination later.
+ */
+
+#ifndef COMPA_HELPER_H
+#define COMPA_HELPER_H
+
+#include <stdint.h>
+
+#define HELPER_NAME		"compa-spawn-helper"
+#define HELPER_FD		3		/* Helper socket descriptor. */
+#define HELPER_MAX_DATA		(256 * 1024)	/* Max. request data length. */
+
+/* Request types. */
+#define HELPER_SPAWN		1	/* Spawn a command. */
+#define HELPER_SIGNAL		2	/* Signal request id process group. */
+
+/* Spawn request flags. */
+#define HELPER_STDIN		0x0001	/* Return a pipe to standard input. */
+#define HELPER_STDOUT		0x0002	/* Return a pipe from standard output. */
+
+/* Reply types. */
+#define HELPER_SPAWNED		1	/* Value is the pid. */
+#define HELPER_FAILED		2	/* Value is an errno code. */
+#define HELPER_EXITED		3	/* Value is the wait status. */
+
+typedef struct {
+	uint32_t		type;
+	uint32_t		id;		/* Request identifier. */
+	uint32_t		flags;
+}		helper_request_t;
+
+typedef struct {
+	uint32_t		type;
+	uint32_t		id;		/* Request identifier. */
+	int32_t			value;
+}		helper_reply_t;
+
+#endif
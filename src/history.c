@@ -0,0 +1,227 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Sample history kept in a ring buffer and drawn as a sparkline.
+ *
+ * Each sample is a one pixel wide bar, the newest at the right. The graph
+ *  is rendered into a cached image surface: when a sample does not change
+ *  the vertical scale, the surface is scrolled by one pixel and only the
+ *  new bar is drawn. It is fully redrawn only when the scale, size or
+ *  color changes.
+ */
+
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include "config.h"
+#include "history.h"
+
+
+struct compa_history {
+	guint			length;		/* Ring buffer size. */
+	guint			count;		/* Number of samples. */
+	guint			head;		/* Next sample index. */
+	gdouble			low;		/* Scale bottom value. */
+	gdouble			high;		/* Scale top value. */
+	cairo_surface_t *	surface;	/* Rendered graph or NULL. */
+	gboolean		stale;		/* Surface must be redrawn. */
+	GdkRGBA			color;		/* Bar color. */
+	gdouble			samples[1];
+};
+
+
+/*
+ *  Create an empty history.
+ */
+compa_history_t *
+history_new(guint length)
+{
+	compa_history_t *history;
+
+	history = g_malloc0(sizeof *history +
+			    (length - 1) * sizeof history->samples[0]);
+	history->length = length;
+	history->stale = TRUE;
+	return history;
+}
+
+
+/*
+ *  Release a history.
+ */
+void
+history_free(compa_history_t *history)
+{
+	if (history) {
+		if (history->surface)
+			cairo_surface_destroy(history->surface);
+		g_free(history);
+	}
+}
+
+
+/*
+ *  Get the i-th sample, 0 being the oldest.
+ */
+static gdouble
+history_sample(const compa_history_t *history, guint i)
+{
+	i += history->head + history->length - history->count;
+	return history->samples[i % history->length];
+}
+
+
+/*
+ *  Draw the bar of the i-th sample at column x, clearing the column first.
+ */
+static void
+history_bar(compa_history_t *history, cairo_t *cr, guint i, gint x)
+{
+	gint height = cairo_image_surface_get_height(history->surface);
+	gdouble v = history_sample(history, i);
+
+	cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+	cairo_rectangle(cr, x, 0, 1, height);
+	cairo_fill(cr);
+
+	v = (v - history->low) / (history->high - history->low) * height;
+	if (v > 0) {
+		cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+		gdk_cairo_set_source_rgba(cr, &history->color);
+		cairo_rectangle(cr, x, height - v, 1, v);
+		cairo_fill(cr);
+	}
+}
+
+
+/*
+ *  Render all samples into the surface.
+ */
+static void
+history_render(compa_history_t *history)
+{
+	gint width = cairo_image_surface_get_width(history->surface);
+	cairo_t *cr = cairo_create(history->surface);
+	guint i;
+
+	cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+	cairo_paint(cr);
+	for (i = 0; i < history->count; i++)
+		history_bar(history, cr, i, width - history->count + i);
+	cairo_destroy(cr);
+	history->stale = FALSE;
+}
+
+
+/*
+ *  Scroll the surface one pixel left and draw the newest sample.
+ */
+static void
+history_scroll(compa_history_t *history)
+{
+	cairo_surface_t *surface = history->surface;
+	gint width = cairo_image_surface_get_width(surface);
+	gint height = cairo_image_surface_get_height(surface);
+	gint stride = cairo_image_surface_get_stride(surface);
+	guchar *row;
+	cairo_t *cr;
+	gint y;
+
+	cairo_surface_flush(surface);
+	row = cairo_image_surface_get_data(surface);
+	for (y = 0; y < height; y++, row += stride)
+		memmove(row, row + 4, (width - 1) * 4);
+	cairo_surface_mark_dirty(surface);
+
+	cr = cairo_create(surface);
+	history_bar(history, cr, history->count - 1, width - 1);
+	cairo_destroy(cr);
+}
+
+
+/*
+ *  Append a sample, dropping the oldest one if the history is full.
+ */
+void
+history_add(compa_history_t *history, gdouble value)
+{
+	gdouble low = 0;
+	gdouble high = 0;
+	guint i;
+
+	history->samples[history->head++] = value;
+	history->head %= history->length;
+	if (history->count < history->length)
+		history->count++;
+
+	/* Scale from the minimum (or zero) to the maximum. */
+	for (i = 0; i < history->count; i++) {
+		value = history_sample(history, i);
+		if (value < low)
+			low = value;
+		if (value > high)
+			high = value;
+	}
+	if (high <= low)
+		high = low + 1;
+
+	if (high != history->high || low != history->low) {
+		history->low = low;
+		history->high = high;
+		history->stale = TRUE;
+	}
+
+	if (!history->stale && history->surface)
+		history_scroll(history);
+}
+
+
+/*
+ *  Paint the graph, rendering it first if needed.
+ */
+void
+history_draw(compa_history_t *history, cairo_t *cr,
+	     gint width, gint height, const GdkRGBA *color)
+{
+	cairo_surface_t *surface = history->surface;
+
+	if (width <= 0 || height <= 0)
+		return;
+
+	if (!surface || cairo_image_surface_get_width(surface) != width ||
+	    cairo_image_surface_get_height(surface) != height) {
+		if (surface)
+			cairo_surface_destroy(surface);
+		history->surface = cairo_image_surface_create(
+					CAIRO_FORMAT_ARGB32, width, height);
+		history->stale = TRUE;
+	}
+
+	if (!gdk_rgba_equal(color, &history->color)) {
+		history->color = *color;
+		history->stale = TRUE;
+	}
+
+	if (history->stale)
+		history_render(history);
+
+	cairo_set_source_surface(cr, history->surface, 0, 0);
+	cairo_paint(cr);
+}
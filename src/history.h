@@ -0,0 +1,37 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Sample history kept in a ring buffer and drawn as a sparkline.
+ */
+
+#ifndef COMPA_HISTORY_H
+#define COMPA_HISTORY_H
+
+#include <gtk/gtk.h>
+
+typedef struct compa_history	compa_history_t;
+
+extern compa_history_t *
+		history_new(guint length);
+extern void	history_free(compa_history_t *history);
+extern void	history_add(compa_history_t *history, gdouble value);
+extern void	history_draw(compa_history_t *history, cairo_t *cr,
+			     gint width, gint height, const GdkRGBA *color);
+
+#endif
@@ -0,0 +1,278 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <gtk/gtk.h>
+
+#include "label.h"
+
+
+/* Field placeholder in compiled template text: a private use character. */
+#define TEMPLATE_SENTINEL	"\xee\x80\x80"	/* U+E000. */
+#define TEMPLATE_SENTINEL_LEN	(sizeof TEMPLATE_SENTINEL - 1)
+
+
+/*
+ * A field placeholder in a compiled template.
+ */
+typedef struct {
+	guint			offset;		/* Sentinel offset in text. */
+	guint			field;		/* Field number: 0 is all. */
+}		template_field_t;
+
+/*
+ * A compiled template: markup is parsed once into plain text with field
+ *  sentinels and attributes.
+ */
+struct compa_template {
+	gchar *			text;		/* Plain text with sentinels. */
+	PangoAttrList *		attrs;		/* Template attributes. */
+	GArray *		fields;		/* Placeholders, by offset. */
+};
+
+/*
+ * Template expansion state.
+ */
+typedef struct {
+	const compa_template_t *template;
+	GArray *		lengths;	/* Substituted values lengths. */
+	PangoAttrList *		attrs;		/* Expanded attributes. */
+}		template_expansion_t;
+
+
+/*
+ *  Display text in a label unless it is already displayed. Return TRUE
+ *   if the label has been changed.
+ */
+gboolean
+label_show(GtkWidget *label, compa_label_t *cache, const gchar *text,
+	   gboolean markup)
+{
+	if (cache->text && !cache->template && markup == cache->markup &&
+	    !strcmp(text, cache->text))
+		return FALSE;
+
+	g_free(cache->text);
+	cache->text = g_strdup(text);
+	cache->markup = markup;
+	cache->template = NULL;
+
+	/* Attributes set by a template are kept by GTK: drop them. */
+	if (gtk_label_get_attributes(GTK_LABEL(label)))
+		gtk_label_set_attributes(GTK_LABEL(label), NULL);
+
+	if (markup)
+		gtk_label_set_markup(GTK_LABEL(label), text);
+	else
+		gtk_label_set_text(GTK_LABEL(label), text);
+	return TRUE;
+}
+
+
+/*
+ *  Compile a markup template: `{N}' is replaced by the N-th whitespace
+ *   separated field of the displayed text and `{0}' by the whole text.
+ *   Return NULL and set `error' if the markup is invalid.
+ */
+compa_template_t *
+template_new(const gchar *markup, GError **error)
+{
+	compa_template_t *t;
+	GString *m = g_string_new(NULL);
+	GArray *numbers = g_array_new(FALSE, FALSE, sizeof(guint));
+	const gchar *p;
+	gchar *end;
+	guint i;
+
+	/* Replace placeholders by sentinels. */
+	for (p = markup; *p; p++) {
+		if (*p == '{' && g_ascii_isdigit(p[1])) {
+			guint n = strtoul(p + 1, &end, 10);
+
+			if (*end == '}') {
+				g_string_append(m, TEMPLATE_SENTINEL);
+				g_array_append_val(numbers, n);
+				p = end;
+				continue;
+			}
+		}
+		g_string_append_c(m, *p);
+	}
+
+	t = g_new0(compa_template_t, 1);
+	t->fields = g_array_new(FALSE, FALSE, sizeof(template_field_t));
+	if (!pango_parse_markup(m->str, -1, 0, &t->attrs, &t->text, NULL,
+				error)) {
+		g_string_free(m, TRUE);
+		g_array_free(numbers, TRUE);
+		template_free(t);
+		return NULL;
+	}
+	g_string_free(m, TRUE);
+
+	/* Locate sentinels in the parsed text: they keep their order. */
+	for (p = t->text, i = 0; (p = strstr(p, TEMPLATE_SENTINEL));
+	     p += TEMPLATE_SENTINEL_LEN, i++) {
+		template_field_t f;
+
+		f.offset = p - t->text;
+		f.field = i < numbers->len? g_array_index(numbers, guint, i): 0;
+		g_array_append_val(t->fields, f);
+	}
+
+	g_array_free(numbers, TRUE);
+	return t;
+}
+
+
+/*
+ *  Release a compiled template.
+ */
+void
+template_free(compa_template_t *template)
+{
+	if (template) {
+		g_free(template->text);
+		if (template->attrs)
+			pango_attr_list_unref(template->attrs);
+		g_array_free(template->fields, TRUE);
+		g_free(template);
+	}
+}
+
+
+/*
+ *  Map a template text index to the expanded text.
+ */
+static guint
+template_map(const template_expansion_t *x, guint index)
+{
+	GArray *fields = x->template->fields;
+	guint i;
+
+	if (index == G_MAXUINT)
+		return index;		/* Up to end of text. */
+
+	for (i = 0; i < fields->len; i++) {
+		if (g_array_index(fields, template_field_t, i).offset >= index)
+			break;
+		index += g_array_index(x->lengths, guint, i);
+		index -= TEMPLATE_SENTINEL_LEN;
+	}
+
+	return index;
+}
+
+
+/*
+ *  Copy a template attribute to the expanded attribute list.
+ */
+static gboolean
+template_attribute(PangoAttribute *attr, gpointer user_data)
+{
+	template_expansion_t *x = user_data;
+	PangoAttribute *a = pango_attribute_copy(attr);
+
+	a->start_index = template_map(x, attr->start_index);
+	a->end_index = template_map(x, attr->end_index);
+	pango_attr_list_insert(x->attrs, a);
+	return FALSE;
+}
+
+
+/*
+ *  Display text through a compiled template. Return TRUE if the label
+ *   has been changed.
+ */
+gboolean
+label_show_template(GtkWidget *label, compa_label_t *cache,
+		    const compa_template_t *template, const gchar *text)
+{
+	template_expansion_t x;
+	GString *s;
+	GPtrArray *words;
+	gchar **tokens;
+	gchar **t;
+	guint start = 0;
+	guint i;
+
+	if (cache->text && cache->template == template &&
+	    !strcmp(text, cache->text))
+		return FALSE;
+
+	g_free(cache->text);
+	cache->text = g_strdup(text);
+	cache->template = template;
+
+	/* Split fields. */
+	tokens = g_strsplit_set(text, " \t\r\n", -1);
+	words = g_ptr_array_new();
+	g_ptr_array_add(words, (gpointer) text);
+	for (t = tokens; *t; t++)
+		if (**t)
+			g_ptr_array_add(words, *t);
+
+	/* Substitute them. */
+	x.template = template;
+	x.lengths = g_array_sized_new(FALSE, FALSE, sizeof(guint),
+				      template->fields->len);
+	s = g_string_new(NULL);
+	for (i = 0; i < template->fields->len; i++) {
+		template_field_t *f = &g_array_index(template->fields,
+						     template_field_t, i);
+		const gchar *value = f->field < words->len?
+				     g_ptr_array_index(words, f->field): "";
+		guint len = strlen(value);
+
+		g_string_append_len(s, template->text + start,
+				    f->offset - start);
+		g_string_append(s, value);
+		g_array_append_val(x.lengths, len);
+		start = f->offset + TEMPLATE_SENTINEL_LEN;
+	}
+	g_string_append(s, template->text + start);
+
+	/* Shift template attributes. */
+	x.attrs = pango_attr_list_new();
+	if (template->attrs)
+		pango_attr_list_filter(template->attrs, template_attribute,
+				       &x);
+
+	gtk_label_set_text(GTK_LABEL(label), s->str);
+	gtk_label_set_attributes(GTK_LABEL(label), x.attrs);
+
+	pango_attr_list_unref(x.attrs);
+	g_array_free(x.lengths, TRUE);
+	g_string_free(s, TRUE);
+	g_ptr_array_free(words, TRUE);
+	g_strfreev(tokens);
+	return TRUE;
+}
+
+
+/*
+ *  Forget the displayed text: it has been changed by other means.
+ */
+void
+label_forget(compa_label_t *cache)
+{
+	g_free(cache->text);
+	cache->text = NULL;
+	cache->template = NULL;
+}
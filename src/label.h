@@ -0,0 +1,47 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Label update avoiding useless reparsing and relayout, and precompiled
+ *  markup templates.
+ */
+
+#ifndef COMPA_LABEL_H
+#define COMPA_LABEL_H
+
+#include <gtk/gtk.h>
+
+typedef struct compa_template	compa_template_t;
+
+typedef struct {
+	gchar *			text;		/* Displayed text or NULL. */
+	gboolean		markup;		/* Displayed text is markup. */
+	const compa_template_t *template;	/* Template used or NULL. */
+}		compa_label_t;
+
+extern gboolean	label_show(GtkWidget *label, compa_label_t *cache,
+			   const gchar *text, gboolean markup);
+extern gboolean	label_show_template(GtkWidget *label, compa_label_t *cache,
+				    const compa_template_t *template,
+				    const gchar *text);
+extern void	label_forget(compa_label_t *cache);
+extern compa_template_t *
+		template_new(const gchar *markup, GError **error);
+extern void	template_free(compa_template_t *template);
+
+#endif
@@ -23,49 +23,147 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
 #include <locale.h>
 #include <libintl.h>
 #include <gtk/gtk.h>
 #include <glib.h>
+#include <glib-unix.h>
 #include <gio/gsettingsbackend.h>
 #include <mate-panel-applet.h>
 #include <mate-panel-applet-gsettings.h>
 
 #include "config.h"
-
-
-#define _(s)	gettext(s)
+#include "command.h"
+#include "run.h"
+#include "label.h"
+#include "sources.h"
+#include "session.h"
+#include "watch.h"
+#include "push.h"
+#include "stats.h"
+#include "style.h"
+#include "history.h"
+
+
+#define _(s)	dgettext(PACKAGE_NAME, s)
 #define N_(s)	s
 
 
+#define UI_RESOURCE		"/org/mate/panel/applet/compa/"
+#define APPLET_UI		UI_RESOURCE "applet.glade"
+#define DIALOG_UI		UI_RESOURCE "compa.glade"
+
 #define DEFAULT_TEXT	"<span font=\"Italic\" color=\"#00FF00\" "	\
 			"bgcolor=\"#333333\">COMPA</span>"
 #define ERROR_TEXT	"<span color=\"#FF0000\">Command Error</span>"
+#define TIMEOUT_TEXT	"<span color=\"#FF0000\">Command Timeout</span>"
 
 #define COMPA_SCHEMA	"org.mate.panel.applet.compa"
 
+/* Monitor modes. */
+#define MONITOR_PERIODIC	0	/* Run command at each period. */
+#define MONITOR_FOLLOW		1	/* Display each output line. */
+#define MONITOR_COPROCESS	2	/* Request/reply on a kept process. */
+
+/* Overlap policies: what to do when a monitor command is still running. */
+#define OVERLAP_SKIP		0	/* Ignore the update. */
+#define OVERLAP_QUEUE		1	/* Update once the command is done. */
+#define OVERLAP_RESTART		2	/* Kill the command and run it again. */
+
+#define COPROCESS_TICK	"tick\n"	/* Coprocess reply request. */
+
+/* Update scheduler parameters. */
+#define SCHEDULER_MAX_RUNNING	4	/* Max. concurrent monitor commands. */
+#define SCHEDULER_STAGGER	250	/* First runs spacing (ms). */
+#define SCHEDULER_SLACK		500	/* Wakeup coalescing window (ms). */
+
+/* Configuration change scopes: what must be redone when a setting changes. */
+#define CONFIG_MONITOR		0x0001	/* Monitor command or source. */
+#define CONFIG_SCHEDULE		0x0002	/* Update period. */
+#define CONFIG_FORMAT		0x0004	/* Output interpretation. */
+#define CONFIG_HISTORY		0x0008	/* History graph. */
+#define CONFIG_TOOLTIP		0x0010	/* Tooltip command. */
+#define CONFIG_FRAME		0x0020	/* Frame style. */
+#define CONFIG_LAYOUT		0x0040	/* Frame alignment and padding. */
+#define CONFIG_ALL		0xFFFF
+
 #define fieldof(t, p, o)	*((t *) (((char *) (p)) + (o)))
 #define boolstring(b)		((b)? "true": "false")
 
 
 typedef struct {
 	gchar *			monitor_command;
+	gchar **		monitor_argv;	/* NULL if shell needed. */
 	gboolean		monitor_markup;
+	gboolean		structured_output;
+	gchar *			label_template;
+	gchar *			style_rules;
+	gint			history_length;	/* Graph samples. */
+	gint			monitor_source;
+	gchar *			source_device;
+	gint			monitor_mode;
 	gint			update_period;	/* Seconds. */
+	gboolean		adaptive_period;
+	gint			max_update_period; /* Seconds. */
+	gchar *			coprocess_terminator;
+	gint			coprocess_timeout; /* Seconds. */
 	gchar *			tooltip_command;
+	gchar **		tooltip_argv;	/* NULL if shell needed. */
 	gboolean		tooltip_markup;
+	gint			tooltip_ttl;	/* Seconds. */
+	gint			output_limit;	/* KiB. */
+	gint			command_timeout; /* Seconds. */
+	gint			overlap_policy;
 	gchar *			click_command;
+	gchar **		click_argv;	/* NULL if shell needed. */
+	gboolean		refresh_on_click;
 	gchar *			background_color;
 	gint			frame_type;
 	gboolean		frame_maximized;
 	gint			padding;
 }		compa_config_t;
 
-typedef struct {
+typedef struct compa		compa_t;
+
+struct compa {
 	GtkWidget *		applet;		/* Panel applet. */
 	GSettings *		gsettings;	/* Configuration settings. */
 	GtkCssProvider *	frame_css;	/* CSS for applet "frame". */
-	guint			active_monitor;	/* Current active monitor. */
+	guint			active_monitor;	/* Follow mode restart timer. */
+	gboolean		scheduled;	/* Known by the scheduler. */
+	gboolean		waiting;	/* Waiting for a run slot. */
+	gint64			due;		/* Next update time (usec). */
+	gint64			period;		/* Current update period (usec). */
+	gboolean		queued;		/* Update queued by overlap. */
+	gboolean		hidden;		/* Applet not mapped. */
+	gboolean		held;		/* Display held by suspension. */
+	compa_run_t *		monitor_run;	/* Running monitor command. */
+	compa_source_t *	source;		/* Built-in data source. */
+	compa_watch_t *		watch;		/* Watched file. */
+	gchar *			pending_text;	/* Label text for next frame. */
+	GHashTable *		pending_keys;	/* Structured keys for next frame. */
+	gchar *			last_output;	/* Last monitor output shown. */
+	guint			pending_tick;	/* Pending label tick callback. */
+	GString *		reply;		/* Coprocess partial reply. */
+	guint			reply_timer;	/* Coprocess reply timeout. */
+	compa_run_t *		tooltip_run;	/* Running tooltip command. */
+	gchar *			tooltip_text;	/* Cached tooltip text. */
+	gboolean		tooltip_markup;	/* Cached tooltip is markup. */
+	gint64			tooltip_time;	/* Cached tooltip timestamp. */
+	gboolean		tooltip_structured; /* Tooltip not from command. */
+	gchar *			style_class;	/* Frame class from monitor. */
+	GSList *		clicks;		/* Running click commands. */
+	compa_label_t		label;		/* Displayed text. */
+	compa_template_t *	template;	/* Compiled label template. */
+	compa_rules_t *		rules;		/* Compiled style rules. */
+	compa_history_t *	history;	/* Graph samples or NULL. */
+	compa_stats_t		stats;		/* Runtime statistics. */
+	guint			stats_id;	/* D-Bus statistics object. */
+	guint			push_id;	/* D-Bus push object. */
+	gchar *			instance_id;	/* Exported instance id. */
+	guint			reconfigure;	/* Settings change callback. */
 	gchar *			command_dir;	/* Last command directory. */
 	gchar *			config_dir;	/* Last config directory. */
 	gchar *			config_file;	/* Last saved config file. */
@@ -73,20 +171,36 @@ typedef struct {
 	/* Applet area widgets. */
 	GtkWidget *		compa_frame;
 	GtkWidget *		compa_eventbox;
+	GtkWidget *		compa_box;
+	GtkWidget *		compa_graph;
 	GtkWidget *		compa_label;
 
 	/* Configure dialog widgets. */
 	GtkWidget *		configure_dialog;
 	GtkWidget *		monitor_entry;
 	GtkWidget *		monitor_markup_check;
+	GtkWidget *		structured_output_check;
+	GtkWidget *		label_template_entry;
+	GtkWidget *		style_rules_entry;
+	GtkWidget *		history_length_spin;
+	GtkWidget *		monitor_mode_combo;
+	GtkWidget *		monitor_source_combo;
+	GtkWidget *		source_device_entry;
 	GtkWidget *		period_spin;
 	GtkWidget *		frame_type_combo;
 	GtkWidget *		frame_maximized_check;
+	GtkWidget *		adaptive_period_check;
+	GtkWidget *		max_update_period_spin;
 	GtkWidget *		padding_spin;
 	GtkWidget *		label_color_button;
 	GtkWidget *		tooltip_entry;
 	GtkWidget *		tooltip_markup_check;
+	GtkWidget *		tooltip_ttl_spin;
+	GtkWidget *		output_limit_spin;
+	GtkWidget *		command_timeout_spin;
+	GtkWidget *		overlap_policy_combo;
 	GtkWidget *		action_entry;
+	GtkWidget *		refresh_on_click_check;
 	GtkWidget *		file_chooser;
 	GtkWidget *		file_load_button;
 	GtkWidget *		file_save_button;
@@ -95,30 +209,53 @@ typedef struct {
 
 	/* Configuration values. */
 	compa_config_t		config;
-}		compa_t;
+};
 
 /*
- * Gtk builder id to address offset table.
+ * Gtk builder id to address offset tables: applet area widgets are built
+ *  at init, dialogs on first use.
  */
 #define IDENTRY(name)	{#name, offsetof(compa_t, name)}
-static const struct {
+typedef struct {
 	const char *	id;
 	size_t		offset;
-}		idtable[] = {
+}		identry_t;
+
+static const identry_t	applet_ids[] = {
 	IDENTRY(compa_label),
 	IDENTRY(compa_eventbox),
+	IDENTRY(compa_box),
+	IDENTRY(compa_graph),
 	IDENTRY(compa_frame),
+	{NULL, 0}
+};
+
+static const identry_t	dialog_ids[] = {
 	IDENTRY(configure_dialog),
 	IDENTRY(monitor_entry),
 	IDENTRY(monitor_markup_check),
+	IDENTRY(structured_output_check),
+	IDENTRY(label_template_entry),
+	IDENTRY(style_rules_entry),
+	IDENTRY(history_length_spin),
+	IDENTRY(monitor_mode_combo),
+	IDENTRY(monitor_source_combo),
+	IDENTRY(source_device_entry),
 	IDENTRY(period_spin),
 	IDENTRY(frame_type_combo),
 	IDENTRY(frame_maximized_check),
+	IDENTRY(adaptive_period_check),
+	IDENTRY(max_update_period_spin),
 	IDENTRY(padding_spin),
 	IDENTRY(label_color_button),
 	IDENTRY(tooltip_entry),
 	IDENTRY(tooltip_markup_check),
+	IDENTRY(tooltip_ttl_spin),
+	IDENTRY(output_limit_spin),
+	IDENTRY(command_timeout_spin),
+	IDENTRY(overlap_policy_combo),
 	IDENTRY(action_entry),
+	IDENTRY(refresh_on_click_check),
 	IDENTRY(file_chooser),
 	IDENTRY(file_load_button),
 	IDENTRY(file_save_button),
@@ -128,10 +265,66 @@ static const struct {
 };
 
 
+/*
+ * Update scheduler: a single one is shared by all the applet instances of
+ *  the factory process, so that their periodic updates share wakeups and
+ *  do not all spawn commands at the same time.
+ */
+static struct {
+	GList *			entries;	/* Scheduled instances. */
+	GQueue			waiting;	/* Due instances without slot. */
+	guint			timer;		/* Wakeup source. */
+	guint			running;	/* Running monitor commands. */
+	gint64			stagger;	/* Next first run time (usec). */
+	gboolean		suspended;	/* Session locked or idle. */
+	GList *			held;		/* Instances with held display. */
+}		scheduler;
+
+
+static void	compa_update(compa_t *p);
+static void	scheduler_arm(void);
+static void	scheduler_run(compa_t *p);
+static void	scheduler_release(void);
+static void	scheduler_adapt(compa_t *p, gboolean changed);
+static gboolean	scheduler_wakeup(gpointer user_data);
+
+
+/*
+ *  Click command exited: update the applet text if configured. The
+ *   instance reference is cleared if it has been destroyed meanwhile.
+ */
+static void
+click_exited(GPid pid, gint status, gpointer user_data)
+{
+	compa_t **ref = user_data;
+	compa_t *p = *ref;
+
+	(void) status;
+
+	g_spawn_close_pid(pid);
+
+	if (p) {
+		p->clicks = g_slist_remove(p->clicks, ref);
+
+		/* A running update may predate the click: queue the refresh
+		   whatever the overlap policy. */
+		if (p->config.refresh_on_click) {
+			if (p->monitor_run &&
+			    p->config.monitor_mode == MONITOR_PERIODIC)
+				p->queued = TRUE;
+			else
+				compa_update(p);
+		}
+	}
+
+	g_free(ref);
+}
+
+
 /*
  *  Action click
  */
-gboolean
+static gboolean
 action_click(GtkWidget *widget, GdkEventButton *event, compa_t *p)
 {
 	compa_config_t *config = &p->config;
@@ -139,14 +332,21 @@ action_click(GtkWidget *widget, GdkEventButton *event, compa_t *p)
 	(void) widget;
 
 	if (event->type == GDK_BUTTON_PRESS && event->button == 1) {
-		if (config->click_command[0]) {
-			char click_cmd_bg[FILENAME_MAX];
+		GPid pid;
 
-			snprintf(click_cmd_bg, sizeof click_cmd_bg, "%s &",
-				 config->click_command);
-
-			if (system(click_cmd_bg))
-				;			/* Ignore. */
+		if (config->click_command[0]) {
+			compa_t **ref = g_new(compa_t *, 1);
+
+			*ref = p;
+			p->stats.spawns++;
+			if (command_spawn(config->click_command,
+					  config->click_argv, &pid, NULL,
+					  NULL, click_exited, ref))
+				p->clicks = g_slist_prepend(p->clicks, ref);
+			else {
+				p->stats.failures++;
+				g_free(ref);
+			}
 		}
 
 		return TRUE;
@@ -163,13 +363,141 @@ static void
 free_config(compa_config_t *config)
 {
 	g_free(config->monitor_command);
+	g_free(config->source_device);
+	g_free(config->label_template);
+	g_free(config->style_rules);
+	g_free(config->coprocess_terminator);
 	g_free(config->tooltip_command);
 	g_free(config->click_command);
 	g_free(config->background_color);
+	g_strfreev(config->monitor_argv);
+	g_strfreev(config->tooltip_argv);
+	g_strfreev(config->click_argv);
 	config->monitor_command = NULL;
+	config->source_device = NULL;
+	config->label_template = NULL;
+	config->style_rules = NULL;
+	config->coprocess_terminator = NULL;
 	config->tooltip_command = NULL;
 	config->click_command = NULL;
 	config->background_color = NULL;
+	config->monitor_argv = NULL;
+	config->tooltip_argv = NULL;
+	config->click_argv = NULL;
+}
+
+
+/*
+ * Duplicate configuration data.
+ */
+static void
+copy_config(compa_config_t *dst, const compa_config_t *src)
+{
+	*dst = *src;
+	dst->monitor_command = g_strdup(src->monitor_command);
+	dst->source_device = g_strdup(src->source_device);
+	dst->label_template = g_strdup(src->label_template);
+	dst->style_rules = g_strdup(src->style_rules);
+	dst->coprocess_terminator = g_strdup(src->coprocess_terminator);
+	dst->tooltip_command = g_strdup(src->tooltip_command);
+	dst->click_command = g_strdup(src->click_command);
+	dst->background_color = g_strdup(src->background_color);
+	dst->monitor_argv = g_strdupv(src->monitor_argv);
+	dst->tooltip_argv = g_strdupv(src->tooltip_argv);
+	dst->click_argv = g_strdupv(src->click_argv);
+}
+
+
+/*
+ * Tokenize configured commands once for all.
+ */
+static void
+parse_commands(compa_config_t *config)
+{
+	g_strfreev(config->monitor_argv);
+	g_strfreev(config->tooltip_argv);
+	g_strfreev(config->click_argv);
+	config->monitor_argv = command_argv(config->monitor_command);
+	config->tooltip_argv = command_argv(config->tooltip_command);
+	config->click_argv = command_argv(config->click_command);
+}
+
+
+/*
+ * Replace a configuration string.
+ */
+static void
+replace_string(gchar **field, gchar *value)
+{
+	g_free(*field);
+	*field = value;
+}
+
+
+/*
+ * Configuration fields and the scope of their changes. Fields not
+ *  listed here are used as is when needed.
+ */
+#define CONFIG_STRING	0
+#define CONFIG_INT	1
+#define CONFIGFIELD(name, type, scope)					\
+		{offsetof(compa_config_t, name), type, scope}
+static const struct {
+	size_t		offset;
+	gint		type;
+	guint		scope;
+}		config_fields[] = {
+	CONFIGFIELD(monitor_command, CONFIG_STRING, CONFIG_MONITOR),
+	CONFIGFIELD(monitor_source, CONFIG_INT, CONFIG_MONITOR),
+	CONFIGFIELD(source_device, CONFIG_STRING, CONFIG_MONITOR),
+	CONFIGFIELD(monitor_mode, CONFIG_INT, CONFIG_MONITOR),
+	CONFIGFIELD(coprocess_terminator, CONFIG_STRING, CONFIG_MONITOR),
+	CONFIGFIELD(coprocess_timeout, CONFIG_INT, CONFIG_MONITOR),
+	CONFIGFIELD(output_limit, CONFIG_INT, CONFIG_MONITOR),
+	CONFIGFIELD(update_period, CONFIG_INT, CONFIG_SCHEDULE),
+	CONFIGFIELD(adaptive_period, CONFIG_INT, CONFIG_SCHEDULE),
+	CONFIGFIELD(max_update_period, CONFIG_INT, CONFIG_SCHEDULE),
+	CONFIGFIELD(monitor_markup, CONFIG_INT, CONFIG_FORMAT),
+	CONFIGFIELD(structured_output, CONFIG_INT, CONFIG_FORMAT),
+	CONFIGFIELD(label_template, CONFIG_STRING, CONFIG_FORMAT),
+	CONFIGFIELD(style_rules, CONFIG_STRING, CONFIG_FORMAT),
+	CONFIGFIELD(history_length, CONFIG_INT, CONFIG_HISTORY),
+	CONFIGFIELD(tooltip_command, CONFIG_STRING, CONFIG_TOOLTIP),
+	CONFIGFIELD(tooltip_markup, CONFIG_INT, CONFIG_TOOLTIP),
+	CONFIGFIELD(tooltip_ttl, CONFIG_INT, CONFIG_TOOLTIP),
+	CONFIGFIELD(background_color, CONFIG_STRING, CONFIG_FRAME),
+	CONFIGFIELD(frame_type, CONFIG_INT, CONFIG_FRAME),
+	CONFIGFIELD(frame_maximized, CONFIG_INT, CONFIG_LAYOUT),
+	CONFIGFIELD(padding, CONFIG_INT, CONFIG_LAYOUT),
+};
+
+
+/*
+ * Compare configurations: return the scopes of changed fields.
+ */
+static guint
+diff_config(const compa_config_t *a, const compa_config_t *b)
+{
+	guint scope = 0;
+	gsize i;
+
+	for (i = 0; i < G_N_ELEMENTS(config_fields); i++) {
+		size_t o = config_fields[i].offset;
+
+		switch (config_fields[i].type) {
+		case CONFIG_STRING:
+			if (g_strcmp0(fieldof(gchar *, a, o),
+				      fieldof(gchar *, b, o)))
+				scope |= config_fields[i].scope;
+			break;
+		default:
+			if (fieldof(gint, a, o) != fieldof(gint, b, o))
+				scope |= config_fields[i].scope;
+			break;
+		}
+	}
+
+	return scope;
 }
 
 
@@ -181,147 +509,1187 @@ load_config(compa_config_t *config, GSettings *g)
 {
 	config->monitor_command = g_settings_get_string(g, "monitor-command");
 	config->monitor_markup = g_settings_get_boolean(g, "monitor-markup");
+	config->structured_output = g_settings_get_boolean(g,
+							   "structured-output");
+	config->label_template = g_settings_get_string(g, "label-template");
+	config->style_rules = g_settings_get_string(g, "style-rules");
+	config->history_length = g_settings_get_int(g, "history-length");
+	config->monitor_source = g_settings_get_enum(g, "monitor-source");
+	config->source_device = g_settings_get_string(g, "source-device");
+	config->monitor_mode = g_settings_get_enum(g, "monitor-mode");
 	config->update_period = g_settings_get_int(g, "update-period");
+	config->adaptive_period = g_settings_get_boolean(g, "adaptive-period");
+	config->max_update_period = g_settings_get_int(g, "max-update-period");
+	config->coprocess_terminator = g_settings_get_string(g,
+						"coprocess-terminator");
+	config->coprocess_timeout = g_settings_get_int(g, "coprocess-timeout");
 	config->tooltip_command = g_settings_get_string(g, "tooltip-command");
 	config->tooltip_markup = g_settings_get_boolean(g, "tooltip-markup");
+	config->tooltip_ttl = g_settings_get_int(g, "tooltip-ttl");
+	config->output_limit = g_settings_get_int(g, "output-limit");
+	config->command_timeout = g_settings_get_int(g, "command-timeout");
+	config->overlap_policy = g_settings_get_enum(g, "overlap-policy");
 	config->click_command = g_settings_get_string(g, "click-command");
+	config->refresh_on_click = g_settings_get_boolean(g,
+							  "refresh-on-click");
 	config->frame_type = g_settings_get_enum(g, "frame-type");
 	config->frame_maximized = g_settings_get_boolean(g, "frame-maximized");
 	config->padding = g_settings_get_int(g, "padding");
 	config->background_color = g_settings_get_string(g, "label-color");
+	parse_commands(config);
+}
+
+
+/*
+ *  Save config
+ */
+static void
+commit_config(compa_config_t *config, GSettings *g)
+{
+	g_settings_set_string(g, "monitor-command", config->monitor_command);
+	g_settings_set_boolean(g, "monitor-markup", config->monitor_markup);
+	g_settings_set_boolean(g, "structured-output",
+			       config->structured_output);
+	g_settings_set_string(g, "label-template", config->label_template);
+	g_settings_set_string(g, "style-rules", config->style_rules);
+	g_settings_set_int(g, "history-length", config->history_length);
+	g_settings_set_enum(g, "monitor-source", config->monitor_source);
+	g_settings_set_string(g, "source-device", config->source_device);
+	g_settings_set_enum(g, "monitor-mode", config->monitor_mode);
+	g_settings_set_int(g, "update-period", config->update_period);
+	g_settings_set_boolean(g, "adaptive-period", config->adaptive_period);
+	g_settings_set_int(g, "max-update-period", config->max_update_period);
+	g_settings_set_string(g, "coprocess-terminator",
+			      config->coprocess_terminator);
+	g_settings_set_int(g, "coprocess-timeout", config->coprocess_timeout);
+	g_settings_set_string(g, "tooltip-command", config->tooltip_command);
+	g_settings_set_boolean(g, "tooltip-markup", config->tooltip_markup);
+	g_settings_set_int(g, "tooltip-ttl", config->tooltip_ttl);
+	g_settings_set_int(g, "output-limit", config->output_limit);
+	g_settings_set_int(g, "command-timeout", config->command_timeout);
+	g_settings_set_enum(g, "overlap-policy", config->overlap_policy);
+	g_settings_set_string(g, "click-command", config->click_command);
+	g_settings_set_boolean(g, "refresh-on-click", config->refresh_on_click);
+	g_settings_set_enum(g, "frame-type", config->frame_type);
+	g_settings_set_boolean(g, "frame-maximized", config->frame_maximized);
+	g_settings_set_int(g, "padding", config->padding);
+	g_settings_set_string(g, "label-color", config->background_color);
+	g_settings_sync();
+}
+
+
+/*
+ *  Start a command on behalf of an applet instance.
+ */
+static compa_run_t *
+compa_run(compa_t *p, const gchar *command, gchar **argv, gboolean input,
+	  void (*done)(compa_run_t *run))
+{
+	return run_start(p, &p->stats, (gsize) p->config.output_limit * 1024,
+			 command, argv, input, done);
+}
+
+
+/*
+ *  Account for a label update.
+ */
+static void
+label_updated(compa_t *p, gboolean changed)
+{
+	if (!changed)
+		p->stats.skipped++;
+	scheduler_adapt(p, changed);
+}
+
+
+/*
+ *  Set label text.
+ */
+static void
+label_set(compa_t *p, const gchar *text, gboolean markup)
+{
+	if (!text || !*text) {
+		text = ERROR_TEXT;
+		markup = TRUE;
+	}
+
+	/* Avoid reparsing and relayout if the output did not change. */
+	label_updated(p, label_show(p->compa_label, &p->label, text, markup));
+}
+
+
+/*
+ *  Set the frame style class from monitor output or style rules.
+ */
+static void
+style_class_set(compa_t *p, gchar *class)
+{
+	GtkStyleContext *context = gtk_widget_get_style_context(p->compa_frame);
+
+	if (class && !*class) {
+		g_free(class);
+		class = NULL;
+	}
+	if (!g_strcmp0(class, p->style_class)) {
+		g_free(class);
+		return;
+	}
+
+	if (p->style_class)
+		gtk_style_context_remove_class(context, p->style_class);
+	g_free(p->style_class);
+	p->style_class = class;
+	if (class)
+		gtk_style_context_add_class(context, class);
+}
+
+
+/*
+ *  Set label text from a data value, through the template if any,
+ *   select the style class matching it and record it in history.
+ */
+static void
+label_set_value(compa_t *p, const gchar *text, gboolean markup)
+{
+	const gchar *class;
+	gdouble value;
+
+	if (p->rules) {
+		class = text? rules_match(p->rules, text): NULL;
+		if (g_strcmp0(class, p->style_class))
+			style_class_set(p, g_strdup(class));
+	}
+
+	if (p->history && text && text_number(text, &value)) {
+		history_add(p->history, value);
+		gtk_widget_queue_draw(p->compa_graph);
+	}
+
+	if (p->template && text && *text)
+		label_updated(p, label_show_template(p->compa_label, &p->label,
+						     p->template, text));
+	else
+		label_set(p, text, markup);
+}
+
+
+/*
+ *  Set label text from monitor output.
+ */
+static void
+label_set_output(compa_t *p, const gchar *text)
+{
+	label_set_value(p, text, p->config.monitor_markup);
+}
+
+
+/*
+ *  Set the tooltip text, served from this cache without a tooltip
+ *   command.
+ */
+static void
+tooltip_set(compa_t *p, gchar *text, gboolean markup)
+{
+	g_free(p->tooltip_text);
+	p->tooltip_text = text;
+	p->tooltip_markup = markup;
+	p->tooltip_time = g_get_monotonic_time();
+	p->tooltip_structured = TRUE;
+	gtk_widget_set_has_tooltip(p->compa_eventbox, TRUE);
+	gtk_tooltip_trigger_tooltip_query(
+	    gtk_widget_get_display(p->compa_eventbox));
+}
+
+
+/*
+ *  Drop the cached tooltip: it is produced again by the tooltip command,
+ *   if any.
+ */
+static void
+tooltip_reset(compa_t *p)
+{
+	compa_config_t *config = &p->config;
+
+	run_cancel(p->tooltip_run);
+	p->tooltip_run = NULL;
+	g_free(p->tooltip_text);
+	p->tooltip_text = NULL;
+	p->tooltip_structured = FALSE;
+	gtk_widget_set_has_tooltip(p->compa_eventbox,
+				   config->tooltip_command[0] != '\0' ||
+				   config->structured_output);
+}
+
+
+/*
+ *  Apply structured monitor output: each line is a key=value pair, where
+ *   value may contain C escapes. Repeated label or tooltip keys append
+ *   lines, missing keys leave their target unchanged.
+ */
+static void
+structured_apply(compa_t *p, const gchar *text)
+{
+	compa_config_t *config = &p->config;
+	GString *label = NULL;
+	GString *tooltip = NULL;
+	gchar *class = NULL;
+	gint delay = -1;
+	gchar **lines;
+	gchar **l;
+
+	lines = g_strsplit(text, "\n", -1);
+	for (l = lines; *l; l++) {
+		gchar *value = strchr(*l, '=');
+		gsize len = strlen(*l);
+		GString **target = NULL;
+
+		if (len && (*l)[len - 1] == '\r')
+			(*l)[len - 1] = '\0';
+		if (!value)
+			continue;
+		*value++ = '\0';
+		value = g_strcompress(value);
+
+		if (!strcmp(*l, "label"))
+			target = &label;
+		else if (!strcmp(*l, "tooltip"))
+			target = &tooltip;
+		else if (!strcmp(*l, "class")) {
+			g_free(class);
+			class = value;
+			value = NULL;
+		}
+		else if (!strcmp(*l, "delay"))
+			delay = atoi(value);
+
+		if (target) {
+			if (!*target)
+				*target = g_string_new(value);
+			else
+				g_string_append_printf(*target, "\n%s", value);
+		}
+		g_free(value);
+	}
+	g_strfreev(lines);
+
+	if (label) {
+		label_set_output(p, label->str);
+		g_string_free(label, TRUE);
+	}
+
+	/* Serve the tooltip from this result: no tooltip command. */
+	if (tooltip)
+		tooltip_set(p, g_string_free(tooltip, FALSE),
+			    config->tooltip_markup);
+
+	if (class)
+		style_class_set(p, class);
+
+	/* Next update delay, overriding the period once. */
+	if (delay >= 0 && p->scheduled) {
+		p->due = g_get_monotonic_time() +
+			 (gint64) delay * G_USEC_PER_SEC;
+		if (!p->waiting)
+			scheduler_arm();
+	}
+}
+
+
+/*
+ *  Hold the display of an instance until the session is resumed.
+ */
+static void
+scheduler_hold(compa_t *p)
+{
+	if (!p->held) {
+		p->held = TRUE;
+		scheduler.held = g_list_prepend(scheduler.held, p);
+	}
+}
+
+
+/*
+ *  Display monitor output. A built-in source value is plain text. While
+ *   the session is suspended, output of followed commands, coprocesses
+ *   and watched files is only kept, to be shown on resume.
+ */
+static void
+monitor_show(compa_t *p, const gchar *text)
+{
+	/* Keep it to render it again in a new format. */
+	if (text != p->last_output) {
+		g_free(p->last_output);
+		p->last_output = g_strdup(text);
+	}
+
+	if (scheduler.suspended) {
+		scheduler_hold(p);
+		return;
+	}
+
+	if (p->source)
+		label_set_value(p, text, FALSE);
+	else if (p->config.structured_output && text && *text)
+		structured_apply(p, text);
+	else
+		label_set_output(p, text);
+}
+
+
+/*
+ *  Watched file update.
+ */
+static void
+watch_update(const gchar *text, gpointer user_data)
+{
+	monitor_show((compa_t *) user_data, text);
+}
+
+
+/*
+ *  Monitor command completion.
+ */
+static void
+monitor_done(compa_run_t *run)
+{
+	compa_t *p = run->p;
+	GString *out = run->output;
+
+	p->monitor_run = NULL;
+
+	while (out->len && (out->str[out->len - 1] == '\n' ||
+			    out->str[out->len - 1] == '\r'))
+		g_string_truncate(out, out->len - 1);
+
+	if (run->timed_out)
+		label_set(p, TIMEOUT_TEXT, TRUE);
+	else
+		monitor_show(p, out->str);
+	stats_latency(p->stats.monitor_latency, run->start);
+
+	/* Run an update that was due while running. */
+	if (p->queued) {
+		p->queued = FALSE;
+		scheduler_run(p);
+	}
+}
+
+
+/*
+ *  Display the last followed line: called at most once per frame.
+ */
+static gboolean
+label_tick(GtkWidget *widget, GdkFrameClock *clock, compa_t *p)
+{
+	(void) widget;
+	(void) clock;
+
+	p->pending_tick = 0;
+	if (p->pending_keys) {
+		GString *text = g_string_new(NULL);
+		GHashTableIter iter;
+		gpointer line;
+
+		g_hash_table_iter_init(&iter, p->pending_keys);
+		while (g_hash_table_iter_next(&iter, NULL, &line))
+			g_string_append_printf(text, "%s%s",
+					       text->len? "\n": "",
+					       (gchar *) line);
+		g_hash_table_destroy(p->pending_keys);
+		p->pending_keys = NULL;
+		monitor_show(p, text->str);
+		g_string_free(text, TRUE);
+	}
+	else {
+		monitor_show(p, p->pending_text);
+		g_free(p->pending_text);
+		p->pending_text = NULL;
+	}
+	return G_SOURCE_REMOVE;
+}
+
+
+/*
+ *  Drop a pending followed line.
+ */
+static void
+label_cancel_pending(compa_t *p)
+{
+	if (p->pending_tick)
+		gtk_widget_remove_tick_callback(p->compa_label,
+						p->pending_tick);
+	p->pending_tick = 0;
+	g_free(p->pending_text);
+	p->pending_text = NULL;
+	if (p->pending_keys)
+		g_hash_table_destroy(p->pending_keys);
+	p->pending_keys = NULL;
+}
+
+
+/*
+ *  Followed command output line.
+ */
+static void
+follow_line(compa_run_t *run, const gchar *line)
+{
+	compa_t *p = run->p;
+	gsize len = strlen(line);
+
+	if (len && line[len - 1] == '\r')
+		len--;
+
+	/* Coalesce lines arriving within the same frame. Structured lines
+	   keep the last value of each key. */
+	if (p->config.structured_output) {
+		const gchar *value = memchr(line, '=', len);
+
+		if (!value)
+			return;
+		if (!p->pending_keys)
+			p->pending_keys = g_hash_table_new_full(g_str_hash,
+								g_str_equal,
+								g_free, g_free);
+		g_hash_table_replace(p->pending_keys,
+				     g_strndup(line, value - line),
+				     g_strndup(line, len));
+	}
+	else {
+		g_free(p->pending_text);
+		p->pending_text = g_strndup(line, len);
+	}
+	if (scheduler.suspended)
+		scheduler_hold(p);
+	else if (!p->pending_tick)
+		p->pending_tick =
+		    gtk_widget_add_tick_callback(p->compa_label,
+						 (GtkTickCallback) label_tick,
+						 p, NULL);
+}
+
+
+/*
+ *  Restart followed command.
+ */
+static gboolean
+follow_restart(compa_t *p)
+{
+	p->active_monitor = 0;
+	compa_update(p);
+	return G_SOURCE_REMOVE;
+}
+
+
+/*
+ *  Arm the followed command restart timer.
+ */
+static void
+follow_schedule(compa_t *p)
+{
+	if (!p->active_monitor)
+		p->active_monitor =
+		    g_timeout_add_seconds(MAX(p->config.update_period, 1),
+					  (GSourceFunc) follow_restart, p);
+}
+
+
+/*
+ *  Followed command termination.
+ */
+static void
+follow_done(compa_run_t *run)
+{
+	compa_t *p = run->p;
+
+	p->monitor_run = NULL;
+	follow_schedule(p);
+}
+
+
+/*
+ *  Forget about the current coprocess reply.
+ */
+static void
+coprocess_reset(compa_t *p)
+{
+	if (p->reply_timer)
+		g_source_remove(p->reply_timer);
+	p->reply_timer = 0;
+	if (p->reply)
+		g_string_truncate(p->reply, 0);
+}
+
+
+/*
+ *  Coprocess output line.
+ */
+static void
+coprocess_line(compa_run_t *run, const gchar *line)
+{
+	compa_t *p = run->p;
+	const gchar *terminator = p->config.coprocess_terminator;
+
+	if (!p->reply)
+		p->reply = g_string_new(NULL);
+
+	if (*terminator) {
+		if (strcmp(line, terminator)) {
+			if (p->reply->len)
+				g_string_append_c(p->reply, '\n');
+			g_string_append(p->reply, line);
+			return;
+		}
+	}
+	else
+		g_string_assign(p->reply, line);
+
+	/* Reply is complete. */
+	if (p->reply->len && p->reply->str[p->reply->len - 1] == '\r')
+		g_string_truncate(p->reply, p->reply->len - 1);
+
+	monitor_show(p, p->reply->str);
+	coprocess_reset(p);
+}
+
+
+/*
+ *  Coprocess reply timeout: the process is restarted at next tick.
+ */
+static gboolean
+coprocess_timeout(compa_t *p)
+{
+	p->reply_timer = 0;
+	coprocess_reset(p);
+	run_cancel(p->monitor_run);
+	p->monitor_run = NULL;
+	label_set(p, NULL, FALSE);
+	return G_SOURCE_REMOVE;
+}
+
+
+/*
+ *  Coprocess termination: it is respawned at next tick.
+ */
+static void
+coprocess_done(compa_run_t *run)
+{
+	compa_t *p = run->p;
+
+	p->monitor_run = NULL;
+	if (p->reply_timer)
+		label_set(p, NULL, FALSE);	/* Died while replying. */
+	coprocess_reset(p);
+}
+
+
+/*
+ *  Request a reply from the coprocess.
+ */
+static void
+coprocess_tick(compa_t *p)
+{
+	static const char tick[] = COPROCESS_TICK;
+	compa_config_t *config = &p->config;
+
+	if (p->reply_timer)
+		return;		/* Previous reply still pending. */
+
+	if (!p->monitor_run) {
+		p->monitor_run = compa_run(p, config->monitor_command,
+					   config->monitor_argv, TRUE,
+					   coprocess_done);
+		if (!p->monitor_run) {
+			label_set(p, NULL, FALSE);
+			return;
+		}
+
+		p->monitor_run->line = coprocess_line;
+	}
+
+	if (run_write(p->monitor_run, tick, sizeof tick - 1) !=
+	    sizeof tick - 1) {
+		if (errno == EAGAIN)
+			return;		/* Coprocess does not read its input. */
+
+		/* Broken pipe: restart it at next tick. */
+		run_cancel(p->monitor_run);
+		p->monitor_run = NULL;
+		label_set(p, NULL, FALSE);
+		return;
+	}
+
+	if (config->coprocess_timeout > 0)
+		p->reply_timer =
+		    g_timeout_add_seconds(config->coprocess_timeout,
+					  (GSourceFunc) coprocess_timeout, p);
+}
+
+
+/*
+ *  Compa update
+ */
+static void
+compa_update(compa_t *p)
+{
+	compa_config_t *config = &p->config;
+
+	if (p->watch) {
+		watch_refresh(p->watch);
+		return;
+	}
+
+	if (p->source) {
+		/* Built-in source: no process to spawn. Its value is shown
+		   like command output. */
+		gchar *text = source_read(p->source);
+
+		monitor_show(p, text);
+		g_free(text);
+		return;
+	}
+
+	if (!config->monitor_command[0])
+		return;
+
+	if (config->monitor_mode == MONITOR_COPROCESS) {
+		coprocess_tick(p);
+		return;
+	}
+
+	/* Do not overlap runs: apply the overlap policy. A followed command
+	   is never restarted here. */
+	if (p->monitor_run && config->monitor_mode != MONITOR_FOLLOW)
+		switch (config->overlap_policy) {
+		case OVERLAP_QUEUE:
+			p->queued = TRUE;
+			return;
+
+		case OVERLAP_RESTART:
+			/* Release its run slot now, not when reaped, and
+			   get a new one from the scheduler. */
+			p->monitor_run->release = NULL;
+			run_cancel(p->monitor_run);
+			p->monitor_run = NULL;
+			scheduler_release();
+			scheduler_run(p);
+			return;
+
+		default:
+			return;
+		}
+
+	if (p->monitor_run)
+		return;
+
+	switch (config->monitor_mode) {
+	case MONITOR_FOLLOW:
+		p->monitor_run = compa_run(p, config->monitor_command,
+					   config->monitor_argv, FALSE,
+					   follow_done);
+		if (p->monitor_run)
+			p->monitor_run->line = follow_line;
+		else
+			follow_schedule(p);
+		break;
+
+	default:
+		p->monitor_run = compa_run(p, config->monitor_command,
+					   config->monitor_argv, FALSE,
+					   monitor_done);
+		if (p->monitor_run) {
+			p->monitor_run->release = scheduler_release;
+			scheduler.running++;
+			run_set_timeout(p->monitor_run,
+					config->command_timeout);
+		}
+		break;
+	}
+
+	if (!p->monitor_run)
+		label_set(p, NULL, FALSE);
+}
+
+
+/*
+ *  Arm the scheduler wakeup timer for the earliest due instance.
+ */
+static void
+scheduler_arm(void)
+{
+	gint64 due = G_MAXINT64;
+	gint64 delay;
+	GList *l;
+
+	if (scheduler.timer)
+		g_source_remove(scheduler.timer);
+	scheduler.timer = 0;
+
+	/* No polling while the session is not in use. */
+	if (scheduler.suspended)
+		return;
+
+	for (l = scheduler.entries; l; l = l->next) {
+		compa_t *p = l->data;
+
+		if (!p->waiting && !p->hidden && p->due < due)
+			due = p->due;
+	}
+
+	if (due == G_MAXINT64)
+		return;
+
+	delay = (due - g_get_monotonic_time()) / 1000;
+	scheduler.timer = g_timeout_add(CLAMP(delay, 0, G_MAXINT),
+					scheduler_wakeup, NULL);
+}
+
+
+/*
+ *  Run a due instance if a run slot is available, else queue it.
+ */
+static void
+scheduler_run(compa_t *p)
+{
+	if (!p->source && p->config.monitor_mode == MONITOR_PERIODIC &&
+	    scheduler.running >= SCHEDULER_MAX_RUNNING) {
+		if (!p->waiting) {
+			p->waiting = TRUE;
+			g_queue_push_tail(&scheduler.waiting, p);
+		}
+	}
+	else
+		compa_update(p);
+}
+
+
+/*
+ *  A periodic monitor command has terminated: run waiting instances.
+ */
+static void
+scheduler_release(void)
+{
+	scheduler.running--;
+
+	while (scheduler.running < SCHEDULER_MAX_RUNNING &&
+	       !g_queue_is_empty(&scheduler.waiting)) {
+		compa_t *p = g_queue_pop_head(&scheduler.waiting);
+
+		p->waiting = FALSE;
+		compa_update(p);
+	}
+}
+
+
+/*
+ *  Scheduler wakeup: update all instances due within the coalescing
+ *   window.
+ */
+static gboolean
+scheduler_wakeup(gpointer user_data)
+{
+	gint64 now = g_get_monotonic_time();
+	gint64 limit = now + SCHEDULER_SLACK * 1000;
+	GList *l;
+	GList *next;
+
+	(void) user_data;
+
+	scheduler.timer = 0;
+
+	for (l = scheduler.entries; l; l = next) {
+		compa_t *p = l->data;
+		gint64 period = p->period;
+
+		next = l->next;
+
+		if (p->waiting || p->hidden || p->due > limit)
+			continue;
+
+		if (period <= 0) {
+			/* Run once. */
+			scheduler.entries = g_list_delete_link(
+						scheduler.entries, l);
+			p->scheduled = FALSE;
+		}
+		else {
+			/* Keep the phase, unless a lot of time has elapsed. */
+			p->due += period;
+			if (p->due <= now)
+				p->due = now + period;
+		}
+
+		scheduler_run(p);
+	}
+
+	scheduler_arm();
+	return G_SOURCE_REMOVE;
+}
+
+
+/*
+ *  Adapt the update period of an instance to its output stability: the
+ *   period doubles while the output is unchanged, up to the configured
+ *   maximum, and returns to the minimum as soon as it changes. The next
+ *   update time is moved accordingly.
+ */
+static void
+scheduler_adapt(compa_t *p, gboolean changed)
+{
+	compa_config_t *config = &p->config;
+	gint64 min = (gint64) config->update_period * G_USEC_PER_SEC;
+	gint64 max = (gint64) config->max_update_period * G_USEC_PER_SEC;
+	gint64 period;
+
+	if (!p->scheduled || !config->adaptive_period || min <= 0)
+		return;
+
+	period = changed? min: MIN(p->period * 2, MAX(min, max));
+	if (period == p->period)
+		return;
+
+	g_debug("Update period %" G_GINT64_FORMAT " ms", period / 1000);
+	p->due += period - p->period;
+	p->period = period;
+	if (!p->waiting)
+		scheduler_arm();
+}
+
+
+/*
+ *  Make an instance due now, staggered with other recently due instances.
+ */
+static void
+scheduler_stagger(compa_t *p)
+{
+	gint64 now = g_get_monotonic_time();
+
+	p->due = MAX(now, scheduler.stagger);
+	scheduler.stagger = p->due + SCHEDULER_STAGGER * 1000;
+}
+
+
+/*
+ *  Add an instance to the scheduler. Its first update is staggered with
+ *   those of other recently added instances.
+ */
+static void
+scheduler_add(compa_t *p)
+{
+	if (!p->scheduled) {
+		p->scheduled = TRUE;
+		scheduler.entries = g_list_prepend(scheduler.entries, p);
+	}
+
+	p->period = (gint64) p->config.update_period * G_USEC_PER_SEC;
+	scheduler_stagger(p);
+	scheduler_arm();
+}
+
+
+/*
+ *  Session state changed: suspend all polling and display updates while
+ *   it is locked or idle, and refresh all instances once on resume.
+ */
+static void
+scheduler_session(gboolean active)
+{
+	GList *l;
+
+	scheduler.suspended = !active;
+
+	if (active) {
+		for (l = scheduler.entries; l; l = l->next)
+			scheduler_stagger(l->data);
+
+		/* Show the output kept meanwhile. */
+		while (scheduler.held) {
+			compa_t *p = scheduler.held->data;
+
+			scheduler.held = g_list_delete_link(scheduler.held,
+							    scheduler.held);
+			p->held = FALSE;
+			if (p->pending_text || p->pending_keys)
+				label_tick(p->compa_label, NULL, p);
+			else if (p->last_output)
+				monitor_show(p, p->last_output);
+		}
+	}
+
+	scheduler_arm();
+}
+
+
+/*
+ *  Applet mapped or unmapped: an invisible instance is not polled, and
+ *   is refreshed once when shown again. An auto-hidden panel is only
+ *   moved off screen: its applets stay mapped and are still polled.
+ */
+static void
+scheduler_visibility(GtkWidget *widget, compa_t *p)
+{
+	gboolean hidden = !gtk_widget_get_mapped(widget);
+
+	if (hidden == p->hidden)
+		return;
+
+	p->hidden = hidden;
+	if (!hidden && p->scheduled)
+		scheduler_stagger(p);
+	scheduler_arm();
+}
+
+
+/*
+ *  Remove an instance from the scheduler.
+ */
+static void
+scheduler_remove(compa_t *p)
+{
+	if (p->waiting)
+		g_queue_remove(&scheduler.waiting, p);
+	p->waiting = FALSE;
+
+	if (p->scheduled) {
+		scheduler.entries = g_list_remove(scheduler.entries, p);
+		p->scheduled = FALSE;
+		scheduler_arm();
+	}
+}
+
+
+/*
+ *  Tooltip command completion.
+ */
+static void
+tooltip_done(compa_run_t *run)
+{
+	compa_t *p = run->p;
+	GString *out = run->output;
+
+	p->tooltip_run = NULL;
+
+	if (out->len && out->str[out->len - 1] == '\n')
+		g_string_truncate(out, out->len - 1);
+
+	g_free(p->tooltip_text);
+	p->tooltip_markup = p->config.tooltip_markup;
+	if (run->timed_out) {
+		p->tooltip_text = g_strdup(TIMEOUT_TEXT);
+		p->tooltip_markup = TRUE;
+	}
+	else if (out->len)
+		p->tooltip_text = g_strdup(out->str);
+	else {
+		p->tooltip_text = g_strdup(ERROR_TEXT);
+		p->tooltip_markup = TRUE;
+	}
+	p->tooltip_time = g_get_monotonic_time();
+	stats_latency(p->stats.tooltip_latency, run->start);
+
+	/* Show the fresh text if the tooltip is being displayed. */
+	gtk_tooltip_trigger_tooltip_query(
+	    gtk_widget_get_display(p->compa_eventbox));
+}
+
+
+/*
+ *  Refresh the tooltip cache in background if it is stale.
+ */
+static void
+tooltip_refresh(compa_t *p)
+{
+	compa_config_t *config = &p->config;
+
+	if (p->tooltip_run || p->tooltip_structured ||
+	    !config->tooltip_command[0])
+		return;
+
+	if (p->tooltip_text && g_get_monotonic_time() - p->tooltip_time <
+	    (gint64) config->tooltip_ttl * G_USEC_PER_SEC)
+		return;
+
+	p->tooltip_run = compa_run(p, config->tooltip_command,
+				   config->tooltip_argv, FALSE, tooltip_done);
+	run_set_timeout(p->tooltip_run, config->command_timeout);
+}
+
+
+/*
+ *  Tooltip query: answer from cache.
+ */
+static gboolean
+tooltip_query(GtkWidget *widget, gint x, gint y, gboolean keyboard_mode,
+	      GtkTooltip *tooltip, compa_t *p)
+{
+	(void) widget;
+	(void) x;
+	(void) y;
+	(void) keyboard_mode;
+
+	tooltip_refresh(p);
+
+	if (!p->tooltip_text)
+		return FALSE;		/* Not yet available. */
+
+	if (p->tooltip_markup)
+		gtk_tooltip_set_markup(tooltip, p->tooltip_text);
+	else
+		gtk_tooltip_set_text(tooltip, p->tooltip_text);
+
+	return TRUE;
+}
+
+
+/*
+ *  Draw the history graph in the label color: in a vertical panel,
+ *   samples run downwards.
+ */
+static gboolean
+graph_draw(GtkWidget *widget, cairo_t *cr, compa_t *p)
+{
+	GtkStyleContext *context = gtk_widget_get_style_context(widget);
+	gint width = gtk_widget_get_allocated_width(widget);
+	gint height = gtk_widget_get_allocated_height(widget);
+	GdkRGBA color;
+
+	if (p->history) {
+		gtk_style_context_get_color(context,
+					    gtk_style_context_get_state(context),
+					    &color);
+		if (gtk_orientable_get_orientation(GTK_ORIENTABLE(p->compa_box))
+		    == GTK_ORIENTATION_VERTICAL) {
+			cairo_translate(cr, width, 0);
+			cairo_rotate(cr, G_PI / 2);
+			history_draw(p->history, cr, height, width, &color);
+		}
+		else
+			history_draw(p->history, cr, width, height, &color);
+	}
+	return FALSE;
 }
 
 
 /*
- *  Save config
+ *  Size the history graph along the panel.
  */
 static void
-commit_config(compa_config_t *config, GSettings *g)
+graph_set_size(compa_t *p)
 {
-	g_settings_set_string(g, "monitor-command", config->monitor_command);
-	g_settings_set_boolean(g, "monitor-markup", config->monitor_markup);
-	g_settings_set_int(g, "update-period", config->update_period);
-	g_settings_set_string(g, "tooltip-command", config->tooltip_command);
-	g_settings_set_boolean(g, "tooltip-markup", config->tooltip_markup);
-	g_settings_set_string(g, "click-command", config->click_command);
-	g_settings_set_enum(g, "frame-type", config->frame_type);
-	g_settings_set_boolean(g, "frame-maximized", config->frame_maximized);
-	g_settings_set_int(g, "padding", config->padding);
-	g_settings_set_string(g, "label-color", config->background_color);
-	g_settings_sync();
+	gint length = p->config.history_length;
+
+	if (gtk_orientable_get_orientation(GTK_ORIENTABLE(p->compa_box)) ==
+	    GTK_ORIENTATION_VERTICAL)
+		gtk_widget_set_size_request(p->compa_graph, -1, length);
+	else
+		gtk_widget_set_size_request(p->compa_graph, length, -1);
 }
 
 
 /*
- *  Tooltip update
+ *  Pushed label text.
  */
-void
-tooltip_update(compa_t *p)
+static void
+push_text(gpointer data, const gchar *text, gboolean markup)
 {
-	compa_config_t *config = &p->config;
-
-	if (config->tooltip_command[0]) {
-		gboolean markup = config->tooltip_markup;
-		FILE *cmd_pipe;
-		unsigned int pipe_char;
-		gchar tooltip_cmd_out[FILENAME_MAX];
-		int i;
+	compa_t *p = data;
 
-		if ((cmd_pipe = popen(config->tooltip_command, "r"))) {
-			for (i = 0; i <= FILENAME_MAX; i++) {
-				pipe_char = getc(cmd_pipe);
-
-				if (pipe_char == EOF)
-					break;
+	if (markup)
+		label_set(p, text, TRUE);
+	else
+		label_set_value(p, text, FALSE);
+}
 
-				tooltip_cmd_out[i] = pipe_char;
-			}
 
-			if (tooltip_cmd_out[i - 1] == '\n')
-				tooltip_cmd_out[i - 1] = 0;
-			else
-				tooltip_cmd_out[i] = 0;
+/*
+ *  Pushed tooltip text: an empty one gives the tooltip back to the
+ *   tooltip command.
+ */
+static void
+push_tooltip(gpointer data, const gchar *text, gboolean markup)
+{
+	compa_t *p = data;
 
-			(void) pclose(cmd_pipe);
-		}
+	if (*text)
+		tooltip_set(p, g_strdup(text), markup);
+	else
+		tooltip_reset(p);
+}
 
-		/* Update label. */
-		if (!tooltip_cmd_out[0]) {
-			snprintf(tooltip_cmd_out, sizeof tooltip_cmd_out,
-				 ERROR_TEXT);
-			markup = TRUE;
-		}
 
-		gtk_widget_set_tooltip_markup(p->compa_eventbox, NULL);
-		gtk_widget_set_tooltip_text(p->compa_eventbox, NULL);
-		if (markup)
-			gtk_widget_set_tooltip_markup(p->compa_eventbox,
-						      tooltip_cmd_out);
-		else
-			gtk_widget_set_tooltip_text(p->compa_eventbox,
-						    tooltip_cmd_out);
-	}
+/*
+ *  Pushed frame style class.
+ */
+static void
+push_style_class(gpointer data, const gchar *class)
+{
+	style_class_set((compa_t *) data, g_strdup(class));
 }
 
 
 /*
- *  Compa update
+ *  Pushed refresh request.
  */
-static gboolean
-compa_update(compa_t *p)
+static void
+push_refresh(gpointer data)
 {
-	compa_config_t *config = &p->config;
-	GtkAlign al = config->frame_maximized? GTK_ALIGN_FILL: GTK_ALIGN_CENTER;
+	compa_update((compa_t *) data);
+}
 
-	gtk_widget_set_halign(p->compa_frame, al);
-	gtk_widget_set_valign(p->compa_frame, al);
 
-	if (config->monitor_command[0]) {
-		gboolean markup = config->monitor_markup;
-		FILE *cmd_pipe;
-		unsigned int pipe_char;
-		gchar monitor_cmd_out[FILENAME_MAX];
-		int i;
+/*
+ *  Export the push interface under the instance id, assigning one first
+ *   if needed. The interface is exported again if the id has changed.
+ */
+static void
+push_init(compa_t *p)
+{
+	static const compa_push_ops_t ops = {
+		push_text, push_tooltip, push_style_class, push_refresh
+	};
+	gchar *id = g_settings_get_string(p->gsettings, "instance-id");
 
-		if ((cmd_pipe = popen(config->monitor_command, "r"))) {
-			for (i = 0; i < sizeof monitor_cmd_out - 1; i++) {
-				pipe_char = getc(cmd_pipe);
+	if (!*id) {
+		g_free(id);
+		id = push_new_id();
+		g_settings_set_string(p->gsettings, "instance-id", id);
+	}
 
-				if (pipe_char == EOF)
-					break;
+	if (!g_strcmp0(id, p->instance_id)) {
+		g_free(id);
+		return;
+	}
 
-				monitor_cmd_out[i] = pipe_char;
-			}
+	push_unexport(p->push_id);
+	p->push_id = 0;
+	g_free(p->instance_id);
+	p->instance_id = id;
 
-			while (i--)
-				if (monitor_cmd_out[i] != '\n' &&
-				    monitor_cmd_out[i] != '\r')
-					break;
+	if (push_valid_id(id))
+		p->push_id = push_export(id, &ops, p);
+	else
+		g_warning("Invalid instance id \"%s\"", id);
+}
 
-			monitor_cmd_out[i + 1] = '\0';
-			(void) pclose(cmd_pipe);
-		}
 
-		/* Update label */
-		if (!monitor_cmd_out[0]) {
-			snprintf(monitor_cmd_out, sizeof monitor_cmd_out,
-				 ERROR_TEXT);
-			markup = TRUE;
-		}
+/*
+ *  Menu statistics
+ */
+static void
+compa_menu_stats(GtkAction *action, gpointer user_data)
+{
+	compa_t *p = (compa_t *) user_data;
+	GtkWidget *dialog;
+	gchar *text;
 
-		gtk_label_set_markup(GTK_LABEL(p->compa_label), NULL);
-		gtk_label_set_text(GTK_LABEL(p->compa_label), NULL);
-		if (markup)
-			gtk_label_set_markup(GTK_LABEL(p->compa_label),
-					     monitor_cmd_out);
-		else
-			gtk_label_set_text(GTK_LABEL(p->compa_label),
-					   monitor_cmd_out);
+	(void) action;
 
-		return TRUE;
-	}
-	else
-		return FALSE;
+	text = stats_format(&p->stats);
+	dialog = gtk_message_dialog_new(NULL, 0, GTK_MESSAGE_INFO,
+					GTK_BUTTONS_CLOSE, "%s", text);
+	gtk_window_set_title(GTK_WINDOW(dialog), _("Compa statistics"));
+	gtk_dialog_run(GTK_DIALOG(dialog));
+	gtk_widget_destroy(dialog);
+	g_free(text);
 }
 
 
@@ -379,7 +1747,7 @@ run_file_chooser(compa_t *p, GtkFileChooserAction action, const char *title,
 /*
  *  File open
  */
-void
+static void
 select_command(GtkWidget *widget, compa_t *p)
 {
 	gchar *filename = run_file_chooser(p, GTK_FILE_CHOOSER_ACTION_OPEN,
@@ -398,7 +1766,7 @@ select_command(GtkWidget *widget, compa_t *p)
 /*
  *  Dialog response
  */
-void
+static void
 dialog_response(GtkWidget *dialog)
 {
 	gtk_widget_hide(dialog);
@@ -443,6 +1811,11 @@ handle_orientation(compa_t *p)
 		break;
 	}
 
+	gtk_orientable_set_orientation(GTK_ORIENTABLE(p->compa_box), vertical?
+				       GTK_ORIENTATION_VERTICAL:
+				       GTK_ORIENTATION_HORIZONTAL);
+	graph_set_size(p);
+
 	if (vertical) {
 		gtk_widget_set_margin_top(p->compa_label, config->padding);
 		gtk_widget_set_margin_bottom(p->compa_label, config->padding);
@@ -455,20 +1828,25 @@ handle_orientation(compa_t *p)
 
 
 /*
- *  Configure applet.
+ *  Configure applet: only the subsystems in `scope' are (re)started.
  */
 
 static void
-applet_configure(compa_t *p)
+applet_configure(compa_t *p, guint scope)
 {
 	compa_config_t *config = &p->config;
+	GtkAlign al = config->frame_maximized? GTK_ALIGN_FILL: GTK_ALIGN_CENTER;
+	gint64 period = (gint64) config->update_period * G_USEC_PER_SEC;
 	gchar *css;
 
 	static gchar const frame_style_format[] =
 		"#compa-frame {background-color: %s;"
 			      "border-color: %s;"
 			      "border-width: %u;"
-			      "border-style: %s;}";
+			      "border-style: %s;}"
+		"#compa-frame.normal {background-color: #26a269;}"
+		"#compa-frame.warning {background-color: #e5a50a;}"
+		"#compa-frame.critical {background-color: #c01c28;}";
 	const struct css_params {
 		const char *	border_style;
 		const char *	border_color;
@@ -484,35 +1862,133 @@ applet_configure(compa_t *p)
 		{	"solid",	"rgba(0,0,0,0.4)",	2	},
 	};
 
+	/* A new period is applied in place, unless periodic updates start
+	   or stop. */
+	if ((scope & CONFIG_SCHEDULE) && p->scheduled &&
+	    p->period > 0 && period > 0) {
+		p->due += period - p->period;
+		p->period = period;
+		if (!p->waiting)
+			scheduler_arm();
+	}
+	else if (scope & CONFIG_SCHEDULE)
+		scope |= CONFIG_MONITOR;
+
 	/* Remove old monitor. */
-	if (p->active_monitor)
-		g_source_remove(p->active_monitor);
-	p->active_monitor = 0;
+	if (scope & CONFIG_MONITOR) {
+		if (p->active_monitor)
+			g_source_remove(p->active_monitor);
+		p->active_monitor = 0;
+		scheduler_remove(p);
+		run_cancel(p->monitor_run);
+		p->monitor_run = NULL;
+		p->queued = FALSE;
+		watch_free(p->watch);
+		p->watch = NULL;
+		label_cancel_pending(p);
+		coprocess_reset(p);
+
+		/* Displayed data belong to the old monitor. */
+		g_free(p->last_output);
+		p->last_output = NULL;
+		label_forget(&p->label);
+		label_show(p->compa_label, &p->label, DEFAULT_TEXT, TRUE);
+	}
+
+	/* Drop cached tooltip. */
+	if (scope & (CONFIG_MONITOR | CONFIG_FORMAT | CONFIG_TOOLTIP))
+		tooltip_reset(p);
+
+	if (scope & (CONFIG_MONITOR | CONFIG_FORMAT))
+		style_class_set(p, NULL);
+
+	if (scope & CONFIG_FORMAT) {
+		/* Compile label template. */
+		template_free(p->template);
+		p->template = NULL;
+		if (config->label_template[0]) {
+			GError *error = NULL;
+
+			p->template = template_new(config->label_template,
+						   &error);
+			if (!p->template) {
+				g_warning("Label template: %s",
+					  error->message);
+				g_error_free(error);
+			}
+		}
 
-	/* Preset default content. */
-	gtk_label_set_text(GTK_LABEL(p->compa_label), NULL);
-	gtk_label_set_markup(GTK_LABEL(p->compa_label), DEFAULT_TEXT);
-	gtk_widget_set_tooltip_text(p->compa_eventbox, "");
+		/* Compile style rules. */
+		rules_free(p->rules);
+		p->rules = NULL;
+		if (config->style_rules[0]) {
+			GError *error = NULL;
 
-	/* Update frame type and background. */
-	b = params + config->frame_type;
-	css = g_strdup_printf(frame_style_format, config->background_color,
-			      b->border_color, b->border_width,
-			      b->border_style);
-	gtk_css_provider_load_from_data(p->frame_css, css, -1, NULL);
-	g_free(css);
+			p->rules = rules_new(config->style_rules, &error);
+			if (error) {
+				g_warning("Style rules: %s", error->message);
+				g_error_free(error);
+			}
+		}
 
-	/* Update padding. */
-	handle_orientation(p);
+		/* Displayed text must be rendered again. */
+		label_forget(&p->label);
+	}
 
-	/* Update displayed data. */
-	compa_update(p);
+	/* Reset history graph. */
+	if (scope & CONFIG_HISTORY) {
+		history_free(p->history);
+		p->history = NULL;
+		if (config->history_length > 0)
+			p->history = history_new(config->history_length);
+		graph_set_size(p);
+		gtk_widget_set_visible(p->compa_graph, p->history != NULL);
+	}
 
-	/* Add new monitor. */
-	if (config->monitor_command[0] && config->update_period)
-		p->active_monitor =
-		    g_timeout_add_seconds(config->update_period,
-					  (GSourceFunc) compa_update, p);
+	/* Update alignment and padding. */
+	if (scope & CONFIG_LAYOUT) {
+		gtk_widget_set_halign(p->compa_frame, al);
+		gtk_widget_set_valign(p->compa_frame, al);
+		handle_orientation(p);
+	}
+
+	/* Update frame type and background. */
+	if (scope & CONFIG_FRAME) {
+		b = params + config->frame_type;
+		css = g_strdup_printf(frame_style_format,
+				      config->background_color,
+				      b->border_color, b->border_width,
+				      b->border_style);
+		gtk_css_provider_load_from_data(p->frame_css, css, -1, NULL);
+		g_free(css);
+	}
+
+	if (!(scope & CONFIG_MONITOR)) {
+		/* Display current data in the new format: a followed command
+		   or a coprocess cannot be asked for it again. */
+		if ((scope & CONFIG_FORMAT) && p->last_output)
+			monitor_show(p, p->last_output);
+		else if (scope & CONFIG_FORMAT)
+			compa_update(p);
+		return;
+	}
+
+	/* Select data source. */
+	source_free(p->source);
+	p->source = source_new(config->monitor_source, config->source_device);
+
+	/* Start updating displayed data: do not wait for its completion.
+	   A followed command or a watched file is not run periodically. */
+	if (config->monitor_source == SOURCE_FILE)
+		p->watch = watch_new(config->source_device,
+				     (gsize) config->output_limit * 1024,
+				     watch_update, p);
+	else if (p->source)
+		scheduler_add(p);
+	else if (config->monitor_mode == MONITOR_FOLLOW)
+		compa_update(p);
+	else if (config->monitor_command[0])
+		scheduler_add(p);
 }
 
 
@@ -520,23 +1996,47 @@ applet_configure(compa_t *p)
  *  Load configuration data into dialog.
  */
 static void
-load_config_dialog_data(compa_t *p)
+load_config_dialog_data(compa_t *p, const compa_config_t *c)
 {
-	compa_config_t *c = &p->config;
 	GdkRGBA color;
 
 	gtk_entry_set_text(GTK_ENTRY(p->monitor_entry),
 			   c->monitor_command? c->monitor_command: "");
 	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(p->monitor_markup_check),
 				     c->monitor_markup);
+	gtk_toggle_button_set_active(
+	    GTK_TOGGLE_BUTTON(p->structured_output_check),
+	    c->structured_output);
+	gtk_entry_set_text(GTK_ENTRY(p->label_template_entry),
+			   c->label_template? c->label_template: "");
+	gtk_entry_set_text(GTK_ENTRY(p->style_rules_entry),
+			   c->style_rules? c->style_rules: "");
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(p->history_length_spin),
+				  c->history_length);
+	gtk_combo_box_set_active(GTK_COMBO_BOX(p->monitor_mode_combo),
+				 c->monitor_mode);
+	gtk_combo_box_set_active(GTK_COMBO_BOX(p->monitor_source_combo),
+				 c->monitor_source);
+	gtk_entry_set_text(GTK_ENTRY(p->source_device_entry),
+			   c->source_device? c->source_device: "");
 	gtk_entry_set_text(GTK_ENTRY(p->tooltip_entry),
 			   c->tooltip_command? c->tooltip_command: "");
 	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(p->tooltip_markup_check),
 				     c->tooltip_markup);
 	gtk_entry_set_text(GTK_ENTRY(p->action_entry),
 			   c->click_command? c->click_command: "");
+	gtk_toggle_button_set_active(
+	    GTK_TOGGLE_BUTTON(p->refresh_on_click_check), c->refresh_on_click);
 	gtk_spin_button_set_value(GTK_SPIN_BUTTON(p->period_spin),
 				  c->update_period);
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(p->tooltip_ttl_spin),
+				  c->tooltip_ttl);
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(p->output_limit_spin),
+				  c->output_limit);
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(p->command_timeout_spin),
+				  c->command_timeout);
+	gtk_combo_box_set_active(GTK_COMBO_BOX(p->overlap_policy_combo),
+				 c->overlap_policy);
 	gtk_spin_button_set_value(GTK_SPIN_BUTTON(p->padding_spin),
 				  c->padding);
 	gdk_rgba_parse(&color, c->background_color);
@@ -546,6 +2046,48 @@ load_config_dialog_data(compa_t *p)
 				 c->frame_type);
 	gtk_toggle_button_set_active(
 	    GTK_TOGGLE_BUTTON(p->frame_maximized_check), c->frame_maximized);
+	gtk_toggle_button_set_active(
+	    GTK_TOGGLE_BUTTON(p->adaptive_period_check), c->adaptive_period);
+	gtk_spin_button_set_value(GTK_SPIN_BUTTON(p->max_update_period_spin),
+				  c->max_update_period);
+}
+
+
+/*
+ *  Settings changed: apply the differences once all changes are known.
+ */
+static gboolean
+applet_reconfigure(gpointer user_data)
+{
+	compa_t *p = user_data;
+	compa_config_t config;
+	guint scope;
+
+	p->reconfigure = 0;
+
+	load_config(&config, p->gsettings);
+	scope = diff_config(&p->config, &config);
+	free_config(&p->config);
+	p->config = config;
+
+	if (scope)
+		applet_configure(p, scope);
+	return G_SOURCE_REMOVE;
+}
+
+
+/*
+ *  Settings change notification.
+ */
+static void
+settings_changed(GSettings *settings, const gchar *key, compa_t *p)
+{
+	(void) settings;
+
+	if (!strcmp(key, "instance-id"))
+		push_init(p);
+	else if (!p->reconfigure)
+		p->reconfigure = g_idle_add(applet_reconfigure, p);
 }
 
 
@@ -557,13 +2099,25 @@ retrieve_config_dialog_data(compa_t *p, compa_config_t *c)
 {
 	GdkRGBA color;
 
-	free_config(c);
-
 	/* Retrieve monitor command. */
-	c->monitor_command = g_strdup(gtk_entry_get_text(
-				GTK_ENTRY(p->monitor_entry)));
+	replace_string(&c->monitor_command, g_strdup(gtk_entry_get_text(
+				GTK_ENTRY(p->monitor_entry))));
 	c->monitor_markup = gtk_toggle_button_get_active(
 				GTK_TOGGLE_BUTTON(p->monitor_markup_check));
+	c->structured_output = gtk_toggle_button_get_active(
+				GTK_TOGGLE_BUTTON(p->structured_output_check));
+	replace_string(&c->label_template, g_strdup(gtk_entry_get_text(
+				GTK_ENTRY(p->label_template_entry))));
+	replace_string(&c->style_rules, g_strdup(gtk_entry_get_text(
+				GTK_ENTRY(p->style_rules_entry))));
+	c->history_length = gtk_spin_button_get_value_as_int(
+				GTK_SPIN_BUTTON(p->history_length_spin));
+	c->monitor_mode = gtk_combo_box_get_active(
+				GTK_COMBO_BOX(p->monitor_mode_combo));
+	c->monitor_source = gtk_combo_box_get_active(
+				GTK_COMBO_BOX(p->monitor_source_combo));
+	replace_string(&c->source_device, g_strdup(gtk_entry_get_text(
+				GTK_ENTRY(p->source_device_entry))));
 
 	/* Retrieve update period. */
 	c->update_period = gtk_spin_button_get_value_as_int(
@@ -574,6 +2128,10 @@ retrieve_config_dialog_data(compa_t *p, compa_config_t *c)
 				GTK_COMBO_BOX(p->frame_type_combo));
 	c->frame_maximized = gtk_toggle_button_get_active(
 				GTK_TOGGLE_BUTTON(p->frame_maximized_check));
+	c->adaptive_period = gtk_toggle_button_get_active(
+				GTK_TOGGLE_BUTTON(p->adaptive_period_check));
+	c->max_update_period = gtk_spin_button_get_value_as_int(
+				GTK_SPIN_BUTTON(p->max_update_period_spin));
 
 	/* Retrieve padding. */
 	c->padding = gtk_spin_button_get_value_as_int(
@@ -582,17 +2140,29 @@ retrieve_config_dialog_data(compa_t *p, compa_config_t *c)
 	/* Retrieve background color. */
 	gtk_color_chooser_get_rgba(
 		GTK_COLOR_CHOOSER(p->label_color_button), &color);
-	c->background_color = gdk_rgba_to_string(&color);
+	replace_string(&c->background_color, gdk_rgba_to_string(&color));
 
 	/* Retrieve tooltip command. */
-	c->tooltip_command = g_strdup(gtk_entry_get_text(
-				GTK_ENTRY(p->tooltip_entry)));
+	replace_string(&c->tooltip_command, g_strdup(gtk_entry_get_text(
+				GTK_ENTRY(p->tooltip_entry))));
 	c->tooltip_markup = gtk_toggle_button_get_active(
 				GTK_TOGGLE_BUTTON(p->tooltip_markup_check));
+	c->tooltip_ttl = gtk_spin_button_get_value_as_int(
+				GTK_SPIN_BUTTON(p->tooltip_ttl_spin));
+	c->output_limit = gtk_spin_button_get_value_as_int(
+				GTK_SPIN_BUTTON(p->output_limit_spin));
+	c->command_timeout = gtk_spin_button_get_value_as_int(
+				GTK_SPIN_BUTTON(p->command_timeout_spin));
+	c->overlap_policy = gtk_combo_box_get_active(
+				GTK_COMBO_BOX(p->overlap_policy_combo));
 
 	/* Retrieve click command. */
-	c->click_command =
-	     g_strdup(gtk_entry_get_text(GTK_ENTRY(p->action_entry)));
+	replace_string(&c->click_command,
+	     g_strdup(gtk_entry_get_text(GTK_ENTRY(p->action_entry))));
+	c->refresh_on_click = gtk_toggle_button_get_active(
+				GTK_TOGGLE_BUTTON(p->refresh_on_click_check));
+
+	parse_commands(c);
 }
 
 
@@ -638,7 +2208,7 @@ gsettings_file(const char *filename)
 /*
  * Load configuration from file.
  */
-void
+static void
 load_pressed(compa_t *p)
 {
 	gchar *filename = run_file_chooser(p, GTK_FILE_CHOOSER_ACTION_OPEN,
@@ -651,8 +2221,12 @@ load_pressed(compa_t *p)
 		if (!g)
 			error(p, _("Cannot load file `%s'"), filename);
 		else {
-			load_config(&p->config, g);
-			load_config_dialog_data(p);
+			compa_config_t config;
+
+			/* Applied only if the dialog is validated. */
+			load_config(&config, g);
+			load_config_dialog_data(p, &config);
+			free_config(&config);
 			g_object_unref(g);
 		}
 
@@ -664,7 +2238,7 @@ load_pressed(compa_t *p)
 /*
  * Save configuration to file.
  */
-void
+static void
 save_pressed(compa_t *p)
 {
 	gchar *filename = run_file_chooser(p, GTK_FILE_CHOOSER_ACTION_SAVE,
@@ -680,9 +2254,11 @@ save_pressed(compa_t *p)
 		else {
 			compa_config_t config;
 
-			memset(&config, 0, sizeof config);
+			/* Settings absent from the dialog are kept as is. */
+			copy_config(&config, &p->config);
 			retrieve_config_dialog_data(p, &config);
 			commit_config(&config, g);
+			free_config(&config);
 			g_object_unref(g);
 		}
 
@@ -691,24 +2267,129 @@ save_pressed(compa_t *p)
 }
 
 
+/*
+ * Disable configuration dialog vertical resizing.
+ */
+static void
+configure_dialog_size_allocate(GtkWidget *dialog, GdkRectangle *allocation,
+			       gpointer user_data)
+{
+	GdkGeometry hints;
+
+	(void) allocation;
+	(void) user_data;
+
+	hints.min_width = 0;
+	hints.max_width = G_MAXINT;
+	hints.min_height = 0;
+	hints.max_height = 1;
+	gtk_window_set_geometry_hints(GTK_WINDOW (dialog), (GtkWidget *) NULL,
+				      &hints, (GdkWindowHints)
+				      (GDK_HINT_MIN_SIZE | GDK_HINT_MAX_SIZE));
+}
+
+
+/*
+ *  Build a UI resource and identify widgets of interest.
+ */
+static GtkBuilder *
+ui_build(compa_t *p, const gchar *resource, const identry_t *ids)
+{
+	GtkBuilder *builder = gtk_builder_new_from_resource(resource);
+
+	/* Handlers are not looked up in the symbol table: the module only
+	   exports its factory. */
+	gtk_builder_add_callback_symbols(builder,
+	    "action_click", G_CALLBACK(action_click),
+	    "configure_dialog_size_allocate",
+	    G_CALLBACK(configure_dialog_size_allocate),
+	    "dialog_response", G_CALLBACK(dialog_response),
+	    "graph_draw", G_CALLBACK(graph_draw),
+	    "load_pressed", G_CALLBACK(load_pressed),
+	    "save_pressed", G_CALLBACK(save_pressed),
+	    "select_command", G_CALLBACK(select_command),
+	    "tooltip_query", G_CALLBACK(tooltip_query),
+	    NULL);
+	gtk_builder_connect_signals(builder, p);
+
+	for (; ids->id; ids++)
+		fieldof(GtkWidget *, p, ids->offset) =
+			GTK_WIDGET(gtk_builder_get_object(builder, ids->id));
+
+	return builder;
+}
+
+
+/*
+ *  Build the configure dialog and its auxiliary dialogs.
+ */
+static void
+dialogs_new(compa_t *p)
+{
+	GtkBuilder *builder = ui_build(p, DIALOG_UI, dialog_ids);
+
+	/* Attach custom data. */
+	g_object_set_data(gtk_builder_get_object(builder,
+						 "monitor_browse_button"),
+			  "compa-target", p->monitor_entry);
+	g_object_set_data(gtk_builder_get_object(builder,
+						 "tooltip_browse_button"),
+			  "compa-target", p->tooltip_entry);
+	g_object_set_data(gtk_builder_get_object(builder,
+						 "action_browse_button"),
+			  "compa-target", p->action_entry);
+
+	g_object_unref(G_OBJECT(builder));
+}
+
+
+/*
+ *  Release the dialogs.
+ */
+static void
+dialogs_free(compa_t *p)
+{
+	const identry_t *ids;
+
+	if (!p->configure_dialog)
+		return;
+
+	gtk_widget_destroy(p->configure_dialog);
+	gtk_widget_destroy(p->error_dialog);
+	gtk_widget_destroy(p->file_chooser);
+
+	for (ids = dialog_ids; ids->id; ids++)
+		fieldof(GtkWidget *, p, ids->offset) = NULL;
+}
+
+
 /*
  *  Config dialog
  */
 static void
 config_dialog(GtkAction *action, compa_t *p)
 {
+	compa_config_t config;
+
+	if (p->configure_dialog) {
+		gtk_window_present(GTK_WINDOW(p->configure_dialog));
+		return;
+	}
+
+	dialogs_new(p);
+	load_config_dialog_data(p, &p->config);
 	gtk_widget_show_all(p->configure_dialog);
 
-	switch (gtk_dialog_run(GTK_DIALOG(p->configure_dialog))) {
-	case GTK_RESPONSE_OK:
-		retrieve_config_dialog_data(p, &p->config);
-		applet_configure(p);
-		commit_config(&p->config, p->gsettings);
-		break;
-	default:
-		load_config_dialog_data(p);
-		break;
+	if (gtk_dialog_run(GTK_DIALOG(p->configure_dialog)) ==
+	    GTK_RESPONSE_OK) {
+		/* Changes are applied on settings change notification. */
+		copy_config(&config, &p->config);
+		retrieve_config_dialog_data(p, &config);
+		commit_config(&config, p->gsettings);
+		free_config(&config);
 	}
+
+	dialogs_free(p);
 }
 
 
@@ -760,9 +2441,7 @@ static void
 compa_destroy(GtkWidget *widget, compa_t *p)
 {
 	/* Remove dialogs. */
-	gtk_widget_destroy(p->configure_dialog);
-	gtk_widget_destroy(p->error_dialog);
-	gtk_widget_destroy(p->file_chooser);
+	dialogs_free(p);
 	g_free(p->command_dir);
 	g_free(p->config_dir);
 	g_free(p->config_file);
@@ -770,9 +2449,38 @@ compa_destroy(GtkWidget *widget, compa_t *p)
 	/* Remove an existing monitor. */
 	if (p->active_monitor)
 		g_source_remove(p->active_monitor);
-
-	if (p->gsettings)
+	scheduler_remove(p);
+	if (p->held)
+		scheduler.held = g_list_remove(scheduler.held, p);
+	run_cancel(p->monitor_run);
+	source_free(p->source);
+	watch_free(p->watch);
+	label_cancel_pending(p);
+	coprocess_reset(p);
+	if (p->reply)
+		g_string_free(p->reply, TRUE);
+	run_cancel(p->tooltip_run);
+	g_free(p->tooltip_text);
+	g_free(p->style_class);
+	g_free(p->last_output);
+	label_forget(&p->label);
+	template_free(p->template);
+	rules_free(p->rules);
+	history_free(p->history);
+	for (; p->clicks; p->clicks = g_slist_delete_link(p->clicks,
+							  p->clicks))
+		*(compa_t **) p->clicks->data = NULL;
+	stats_unexport(p->stats_id);
+	push_unexport(p->push_id);
+
+	if (p->reconfigure)
+		g_source_remove(p->reconfigure);
+	g_free(p->instance_id);
+
+	if (p->gsettings) {
+		g_signal_handlers_disconnect_by_data(p->gsettings, p);
 		g_object_unref(p->gsettings);
+	}
 
 	/* Remove frame CSS. */
 	g_object_unref(p->frame_css);
@@ -795,6 +2503,7 @@ init_popup_menu(MatePanelApplet *applet, compa_t *p)
 	static const char menu[] =
 	    "   <menuitem name=\"update_item\" action=\"update_verb\" />"
 	    "   <menuitem name=\"configure_item\" action=\"configure_verb\" />"
+	    "   <menuitem name=\"stats_item\" action=\"stats_verb\" />"
 	    "   <menuitem name=\"about_item\" action=\"about_verb\" />";
 	static const GtkActionEntry verbs[] = {
 		{
@@ -805,6 +2514,10 @@ init_popup_menu(MatePanelApplet *applet, compa_t *p)
 			"configure_verb", GTK_STOCK_PROPERTIES,
 			N_("_Configure"), NULL, NULL, G_CALLBACK(config_dialog)
 		},
+		{
+			"stats_verb", GTK_STOCK_INFO, N_("_Statistics"),
+			NULL, NULL, G_CALLBACK(compa_menu_stats)
+		},
 		{
 			"about_verb", GTK_STOCK_ABOUT, N_("_About"),
 			NULL, NULL, G_CALLBACK(about_dialog)
@@ -821,28 +2534,6 @@ init_popup_menu(MatePanelApplet *applet, compa_t *p)
 }
 
 
-/*
- * Disable configuration dialog vertical resizing.
- */
-void
-configure_dialog_size_allocate(GtkWidget *dialog, GdkRectangle *allocation,
-			       gpointer user_data)
-{
-	GdkGeometry hints;
-
-	(void) allocation;
-	(void) user_data;
-
-	hints.min_width = 0;
-	hints.max_width = G_MAXINT;
-	hints.min_height = 0;
-	hints.max_height = 1;
-	gtk_window_set_geometry_hints(GTK_WINDOW (dialog), (GtkWidget *) NULL,
-				      &hints, (GdkWindowHints)
-				      (GDK_HINT_MIN_SIZE | GDK_HINT_MAX_SIZE));
-}
-
-
 /*
  *  Compa init
  */
@@ -853,15 +2544,19 @@ compa_init(MatePanelApplet *applet)
 	GtkBuilder *builder;
 	GtkStyleContext *context;
 
-	size_t i;
-
 	/* i18n. */
 	bindtextdomain(PACKAGE_NAME, LOCALEDIR);
 	bind_textdomain_codeset(PACKAGE_NAME, "UTF-8");
 
-	/* Init. */
+	/* Init. Process-wide names are left to the panel when in-process. */
+#ifndef COMPA_IN_PROCESS
 	g_set_application_name("Compa");
 	gtk_window_set_default_icon_name("gtk-properties");
+#endif
+
+	/* Process-wide command spawner and session state watcher. */
+	helper_start();
+	session_watch(scheduler_session);
 
 	/* This instance data. */
 	p = g_new0(compa_t, 1);
@@ -875,28 +2570,8 @@ compa_init(MatePanelApplet *applet)
 	/* Load config. */
 	load_config(&p->config, p->gsettings);
 
-	/* GUI builder. */
-	builder = gtk_builder_new_from_file(PKGDATADIR "/compa.glade");
-	gtk_builder_connect_signals(builder, p);
-
-	/* Identify widgets of interest. */
-	for (i = 0; idtable[i].id; i++) {
-		GtkWidget **w = &fieldof(GtkWidget *, p, idtable[i].offset);
-		*w = GTK_WIDGET(gtk_builder_get_object(builder, idtable[i].id));
-	}
-
-	/* Attach custom data. */
-	g_object_set_data(gtk_builder_get_object(builder,
-						 "monitor_browse_button"),
-			  "compa-target", p->monitor_entry);
-	g_object_set_data(gtk_builder_get_object(builder,
-						 "tooltip_browse_button"),
-			  "compa-target", p->tooltip_entry);
-	g_object_set_data(gtk_builder_get_object(builder,
-						 "action_browse_button"),
-			  "compa-target", p->action_entry);
-
-	/* Set-up client area. */
+	/* Set-up client area: dialogs are built when needed. */
+	builder = ui_build(p, APPLET_UI, applet_ids);
 	mate_panel_applet_set_flags(MATE_PANEL_APPLET(p->applet),
 				    MATE_PANEL_APPLET_EXPAND_MINOR);
 	gtk_container_add(GTK_CONTAINER(p->applet), p->compa_frame);
@@ -910,18 +2585,25 @@ compa_init(MatePanelApplet *applet)
 				       GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
 
 	/* Display configured data. */
-	applet_configure(p);
-
-	/* Complete configure dialog with current configuration data. */
-	load_config_dialog_data(p);
+	applet_configure(p, CONFIG_ALL);
 
 	/* Popup menu. */
 	init_popup_menu(applet, p);
 
+	/* Statistics and push interface on the session bus. */
+	p->stats_id = stats_export(&p->stats, &p->config.monitor_command);
+	push_init(p);
+
 	g_signal_connect_swapped(G_OBJECT(applet), "change-orient",
 			 G_CALLBACK(handle_orientation), p);
 	g_signal_connect(G_OBJECT(applet), "destroy",
 			 G_CALLBACK(compa_destroy), p);
+	g_signal_connect(G_OBJECT(p->gsettings), "changed",
+			 G_CALLBACK(settings_changed), p);
+	g_signal_connect_after(G_OBJECT(applet), "map",
+			       G_CALLBACK(scheduler_visibility), p);
+	g_signal_connect_after(G_OBJECT(applet), "unmap",
+			       G_CALLBACK(scheduler_visibility), p);
 	gtk_widget_show_all(GTK_WIDGET(p->applet));
 }
 
@@ -940,6 +2622,19 @@ applet_factory(MatePanelApplet *applet, const gchar *iid, gpointer user_data)
 }
 
 
+#ifdef COMPA_IN_PROCESS
+
+/* Library loaded by the panel. */
+MATE_PANEL_APPLET_IN_PROCESS_FACTORY(
+	"compaAppletFactory",
+	PANEL_TYPE_APPLET,
+	"Compa",
+	applet_factory,
+	NULL
+);
+
+#else
+
 /*
  * Dirty hack to force UTF-8 locale.
  */
@@ -965,3 +2660,5 @@ MATE_PANEL_APPLET_OUT_PROCESS_FACTORY(
 	applet_factory,
 	NULL
 );
+
+#endif
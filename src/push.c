@@ -0,0 +1,212 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Per-instance D-Bus interface through which external programs push
+ *  data to the applet.
+ *
+ * The object path ends with the instance id, kept in the settings so that
+ *  it remains stable across sessions.
+ *
+ * A pushed tooltip replaces the tooltip command output until an empty
+ *  tooltip is pushed or the monitor or tooltip settings change.
+ */
+
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include "config.h"
+#include "push.h"
+
+#define PUSH_PATH		"/org/mate/panel/applet/compa/Applet/%s"
+#define PUSH_INTERFACE		"org.mate.panel.applet.compa.Control"
+
+
+static const gchar	introspection[] =
+	"<node>"
+	"  <interface name='" PUSH_INTERFACE "'>"
+	"    <method name='SetText'>"
+	"      <arg name='text' type='s' direction='in'/>"
+	"    </method>"
+	"    <method name='SetMarkup'>"
+	"      <arg name='markup' type='s' direction='in'/>"
+	"    </method>"
+	"    <method name='SetTooltip'>"
+	"      <arg name='text' type='s' direction='in'/>"
+	"    </method>"
+	"    <method name='SetTooltipMarkup'>"
+	"      <arg name='markup' type='s' direction='in'/>"
+	"    </method>"
+	"    <method name='SetStyleClass'>"
+	"      <arg name='class' type='s' direction='in'/>"
+	"    </method>"
+	"    <method name='Refresh'/>"
+	"  </interface>"
+	"</node>";
+
+/*
+ *  Exported object.
+ */
+typedef struct {
+	const compa_push_ops_t *ops;
+	gpointer		data;
+}		push_object_t;
+
+
+/*
+ *  Check an instance id: it must be a valid object path element.
+ */
+gboolean
+push_valid_id(const gchar *id)
+{
+	if (!id || !*id)
+		return FALSE;
+	for (; *id; id++)
+		if (!g_ascii_isalnum(*id) && *id != '_')
+			return FALSE;
+	return TRUE;
+}
+
+
+/*
+ *  Generate a new random instance id.
+ */
+gchar *
+push_new_id(void)
+{
+	return g_strdup_printf("%08x%08x", g_random_int(), g_random_int());
+}
+
+
+/*
+ *  Check pushed markup.
+ */
+static gboolean
+push_check_markup(GDBusMethodInvocation *invocation, const gchar *markup)
+{
+	GError *error = NULL;
+
+	if (pango_parse_markup(markup, -1, 0, NULL, NULL, NULL, &error))
+		return TRUE;
+	g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+					      G_DBUS_ERROR_INVALID_ARGS,
+					      "%s", error->message);
+	g_error_free(error);
+	return FALSE;
+}
+
+
+/*
+ *  D-Bus method call.
+ */
+static void
+push_method_call(GDBusConnection *connection, const gchar *sender,
+		 const gchar *path, const gchar *interface,
+		 const gchar *method, GVariant *parameters,
+		 GDBusMethodInvocation *invocation, gpointer user_data)
+{
+	push_object_t *o = user_data;
+	const compa_push_ops_t *ops = o->ops;
+	const gchar *s = NULL;
+
+	(void) connection;
+	(void) sender;
+	(void) path;
+	(void) interface;
+
+	if (g_variant_n_children(parameters))
+		g_variant_get(parameters, "(&s)", &s);
+
+	if (!strcmp(method, "SetText"))
+		ops->text(o->data, s, FALSE);
+	else if (!strcmp(method, "SetMarkup")) {
+		if (!push_check_markup(invocation, s))
+			return;
+		ops->text(o->data, s, TRUE);
+	}
+	else if (!strcmp(method, "SetTooltip"))
+		ops->tooltip(o->data, s, FALSE);
+	else if (!strcmp(method, "SetTooltipMarkup")) {
+		if (!push_check_markup(invocation, s))
+			return;
+		ops->tooltip(o->data, s, TRUE);
+	}
+	else if (!strcmp(method, "SetStyleClass"))
+		ops->style_class(o->data, s);
+	else if (!strcmp(method, "Refresh"))
+		ops->refresh(o->data);
+
+	g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+
+/*
+ *  Export the push interface of an instance on the session bus. Returns
+ *   a registration id or 0.
+ */
+guint
+push_export(const gchar *id, const compa_push_ops_t *ops, gpointer data)
+{
+	static const GDBusInterfaceVTable vtable = {
+		push_method_call, NULL, NULL
+	};
+	static GDBusNodeInfo *info;
+	GDBusConnection *bus;
+	push_object_t *o;
+	gchar *path;
+	guint registration;
+
+	bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+	if (!bus)
+		return 0;
+
+	if (!info)
+		info = g_dbus_node_info_new_for_xml(introspection, NULL);
+
+	o = g_new(push_object_t, 1);
+	o->ops = ops;
+	o->data = data;
+	path = g_strdup_printf(PUSH_PATH, id);
+	registration = g_dbus_connection_register_object(bus, path,
+							 info->interfaces[0],
+							 &vtable, o, g_free,
+							 NULL);
+	g_free(path);
+	g_object_unref(bus);
+	return registration;
+}
+
+
+/*
+ *  Withdraw the push interface.
+ */
+void
+push_unexport(guint registration)
+{
+	GDBusConnection *bus;
+
+	if (!registration)
+		return;
+
+	bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+	if (bus) {
+		g_dbus_connection_unregister_object(bus, registration);
+		g_object_unref(bus);
+	}
+}
@@ -0,0 +1,43 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Per-instance D-Bus interface through which external programs push
+ *  data to the applet.
+ */
+
+#ifndef COMPA_PUSH_H
+#define COMPA_PUSH_H
+
+#include <glib.h>
+
+/* Pushed data handlers. */
+typedef struct {
+	void	(*text)(gpointer data, const gchar *text, gboolean markup);
+	void	(*tooltip)(gpointer data, const gchar *text, gboolean markup);
+	void	(*style_class)(gpointer data, const gchar *class);
+	void	(*refresh)(gpointer data);
+}		compa_push_ops_t;
+
+extern gboolean	push_valid_id(const gchar *id);
+extern gchar *	push_new_id(void);
+extern guint	push_export(const gchar *id, const compa_push_ops_t *ops,
+			    gpointer data);
+extern void	push_unexport(guint registration);
+
+#endif
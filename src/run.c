@@ -0,0 +1,335 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include <glib-unix.h>
+
+#include "command.h"
+#include "run.h"
+
+
+/* Command output reading. */
+#define OUTPUT_CHUNK	16384		/* Read size. */
+
+
+/*
+ * Release a command run.
+ */
+static void
+run_free(compa_run_t *run)
+{
+	if (run->release)
+		run->release();
+	if (run->timer)
+		g_source_remove(run->timer);
+	if (run->out_watch)
+		g_source_remove(run->out_watch);
+	if (run->in >= 0)
+		close(run->in);
+	if (run->out)
+		g_io_channel_unref(run->out);
+	if (run->output)
+		g_string_free(run->output, TRUE);
+	g_free(run);
+}
+
+
+/*
+ * Complete a command run when both its output is exhausted and its
+ *  process has exited.
+ */
+static void
+run_check_done(compa_run_t *run)
+{
+	if (run->out_watch || run->alive)
+		return;
+
+	if (run->stats && !run->timed_out &&
+	    (!WIFEXITED(run->status) || WEXITSTATUS(run->status)))
+		run->stats->failures++;
+
+	if (run->p && run->done)
+		run->done(run);
+
+	run_free(run);
+}
+
+
+/*
+ * Deliver complete output lines. At end of file, an incomplete last line
+ *  is delivered too.
+ */
+static void
+run_lines(compa_run_t *run, gboolean eof)
+{
+	GString *out = run->output;
+	gsize start = 0;
+	gchar *nl;
+
+	while (run->p &&
+	       (nl = memchr(out->str + start, '\n', out->len - start))) {
+		*nl = '\0';
+		run->line(run, out->str + start);
+		start = nl + 1 - out->str;
+	}
+
+	if (eof && run->p && start < out->len) {
+		run->line(run, out->str + start);
+		start = out->len;
+	}
+
+	g_string_erase(out, 0, start);
+}
+
+
+/*
+ * Enforce the output size limit on data appended from `start'. In line
+ *  mode, the limit applies to each line and data is discarded up to the
+ *  end of a truncated line.
+ */
+static void
+run_limit(compa_run_t *run, gsize start)
+{
+	GString *out = run->output;
+	gsize cut;
+	gchar *nl;
+
+	if (run->truncated) {
+		nl = NULL;
+		if (run->line)
+			nl = memchr(out->str + start, '\n', out->len - start);
+		if (!nl) {
+			g_string_truncate(out, start);
+			return;
+		}
+		g_string_erase(out, start, nl - out->str - start);
+		g_string_insert(out, start, OUTPUT_MARKER);
+		run->truncated = FALSE;
+	}
+
+	if (run->line)
+		run_lines(run, FALSE);
+
+	if (out->len > run->limit) {
+		/* Do not split an UTF-8 character. */
+		for (cut = run->limit; cut && (out->str[cut] & 0xC0) == 0x80;)
+			cut--;
+		g_string_truncate(out, cut);
+		run->truncated = TRUE;
+	}
+}
+
+
+/*
+ * Collect command output as it arrives, reading it directly into the
+ *  growable output buffer.
+ */
+static gboolean
+run_output(GIOChannel *channel, GIOCondition condition, compa_run_t *run)
+{
+	GString *out = run->output;
+	gsize start;
+	gsize len;
+	GIOStatus status;
+	gboolean eof;
+
+	(void) condition;
+
+	do {
+		start = out->len;
+		g_string_set_size(out, start + OUTPUT_CHUNK);
+		len = 0;
+		status = g_io_channel_read_chars(channel, out->str + start,
+						 OUTPUT_CHUNK, &len, NULL);
+		g_string_truncate(out, start + len);
+		if (run->stats)
+			run->stats->bytes += len;
+		if (len)
+			run_limit(run, start);
+	} while (status == G_IO_STATUS_NORMAL);
+
+	eof = status != G_IO_STATUS_AGAIN;
+	if (eof && run->truncated)
+		g_string_append(out, OUTPUT_MARKER);
+
+	if (run->line)
+		run_lines(run, eof);
+
+	if (!eof)
+		return TRUE;
+
+	/* End of file or error. */
+	run->out_watch = 0;
+	run_check_done(run);
+	return FALSE;
+}
+
+
+/*
+ * Command process exited.
+ */
+static void
+run_exited(GPid pid, gint status, compa_run_t *run)
+{
+	g_spawn_close_pid(pid);
+	run->pid = 0;
+	run->alive = FALSE;
+	run->status = status;
+	run_check_done(run);
+}
+
+
+/*
+ * Start a command asynchronously on behalf of owner `p'. The `done'
+ *  procedure is called once the whole output has been read and the
+ *  process has terminated. If `argv' is not NULL, it is executed directly
+ *  rather than `command' through the shell. If `input' is true, a
+ *  non-blocking pipe to the command standard input is kept in the run
+ *  structure. Output beyond `limit' bytes (at least OUTPUT_LIMIT_MIN) is
+ *  discarded. Counters are updated in `stats' if not NULL.
+ */
+compa_run_t *
+run_start(gpointer p, compa_stats_t *stats, gsize limit,
+	  const gchar *command, gchar **argv, gboolean input,
+	  void (*done)(compa_run_t *run))
+{
+	compa_run_t *run;
+	gint out;
+
+	run = g_new0(compa_run_t, 1);
+	run->in = -1;
+	run->start = g_get_monotonic_time();
+
+	if (stats)
+		stats->spawns++;
+	if (!command_spawn(command, argv, &run->pid, input? &run->in: NULL,
+			   &out, (GChildWatchFunc) run_exited, run)) {
+		if (stats)
+			stats->failures++;
+		g_free(run);
+		return NULL;
+	}
+
+	if (run->in >= 0)
+		g_unix_set_fd_nonblocking(run->in, TRUE, NULL);
+
+	run->p = p;
+	run->stats = stats;
+	run->done = done;
+	run->output = g_string_new(NULL);
+	run->limit = MAX(limit, OUTPUT_LIMIT_MIN);
+	run->out = g_io_channel_unix_new(out);
+	g_io_channel_set_close_on_unref(run->out, TRUE);
+	g_io_channel_set_encoding(run->out, NULL, NULL);
+	g_io_channel_set_buffered(run->out, FALSE);
+	g_io_channel_set_flags(run->out, G_IO_FLAG_NONBLOCK, NULL);
+	run->out_watch = g_io_add_watch(run->out,
+					G_IO_IN | G_IO_HUP | G_IO_ERR,
+					(GIOFunc) run_output, run);
+	run->alive = TRUE;
+	return run;
+}
+
+
+/*
+ * Command run timeout: kill it. Its completion is then processed normally.
+ */
+static gboolean
+run_timeout(gpointer user_data)
+{
+	compa_run_t *run = user_data;
+
+	run->timer = 0;
+	run->timed_out = TRUE;
+	if (run->stats)
+		run->stats->timeouts++;
+	if (run->pid)
+		command_kill(run->pid, SIGKILL);
+	return G_SOURCE_REMOVE;
+}
+
+
+/*
+ * Set a command run deadline in seconds, if positive.
+ */
+void
+run_set_timeout(compa_run_t *run, gint seconds)
+{
+	if (run && seconds > 0)
+		run->timer = g_timeout_add_seconds(seconds, run_timeout, run);
+}
+
+
+/*
+ * Write to a command run input. The process signal disposition is not
+ *  ours to change (the applet may be loaded in the panel): SIGPIPE is
+ *  blocked during the write and a signal it raises is consumed, so that a
+ *  closed input only fails with EPIPE.
+ */
+gssize
+run_write(compa_run_t *run, const void *buf, gsize len)
+{
+	static const struct timespec now = { 0, 0 };
+	sigset_t sigpipe;
+	sigset_t pending;
+	sigset_t saved;
+	gboolean was_pending;
+	gssize written;
+	gint error;
+
+	sigemptyset(&sigpipe);
+	sigaddset(&sigpipe, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &sigpipe, &saved);
+	sigpending(&pending);
+	was_pending = sigismember(&pending, SIGPIPE);
+
+	written = write(run->in, buf, len);
+	error = errno;
+
+	/* Consume our own SIGPIPE only. */
+	if (written < 0 && error == EPIPE && !was_pending)
+		while (sigtimedwait(&sigpipe, NULL, &now) < 0 && errno == EINTR)
+			;
+
+	pthread_sigmask(SIG_SETMASK, &saved, NULL);
+	errno = error;
+	return written;
+}
+
+
+/*
+ * Abandon a command run: the process is terminated and its results will
+ *  be ignored.
+ */
+void
+run_cancel(compa_run_t *run)
+{
+	if (run) {
+		run->p = NULL;
+		run->stats = NULL;
+		if (run->pid)
+			command_kill(run->pid, SIGTERM);
+	}
+}
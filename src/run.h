@@ -0,0 +1,64 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Asynchronously running commands and their output collection.
+ */
+
+#ifndef COMPA_RUN_H
+#define COMPA_RUN_H
+
+#include <glib.h>
+
+#include "stats.h"
+
+#define OUTPUT_MARKER	"\xe2\x80\xa6"	/* Truncation marker (ellipsis). */
+#define OUTPUT_LIMIT_MIN	1024		/* Min. output limit (bytes). */
+
+typedef struct compa_run	compa_run_t;
+
+struct compa_run {
+	gpointer		p;		/* Owner, NULL if detached. */
+	compa_stats_t *		stats;		/* Owner statistics or NULL. */
+	GPid			pid;		/* Child process id. */
+	gint			in;		/* Child standard input or -1. */
+	GIOChannel *		out;		/* Child standard output. */
+	guint			out_watch;	/* Output watch source. */
+	gboolean		alive;		/* Process not yet reaped. */
+	gint			status;		/* Child wait status. */
+	GString *		output;		/* Collected output. */
+	gsize			limit;		/* Output size limit. */
+	gboolean		truncated;	/* Output exceeded the limit. */
+	gint64			start;		/* Spawn time (usec). */
+	guint			timer;		/* Timeout source. */
+	gboolean		timed_out;	/* Killed by timeout. */
+	void			(*line)(compa_run_t *run, const gchar *line);
+	void			(*done)(compa_run_t *run);
+	void			(*release)(void); /* Called when freed. */
+};
+
+extern compa_run_t *	run_start(gpointer p, compa_stats_t *stats,
+				  gsize limit, const gchar *command,
+				  gchar **argv, gboolean input,
+				  void (*done)(compa_run_t *run));
+extern void		run_set_timeout(compa_run_t *run, gint seconds);
+extern gssize		run_write(compa_run_t *run, const void *buf,
+				  gsize len);
+extern void		run_cancel(compa_run_t *run);
+
+#endif
@@ -0,0 +1,328 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gio/gio.h>
+
+#include "session.h"
+
+
+#define LOGIN1_NAME		"org.freedesktop.login1"
+#define LOGIN1_PATH		"/org/freedesktop/login1"
+#define LOGIN1_AUTO		LOGIN1_PATH "/session/auto"
+#define LOGIN1_MANAGER		LOGIN1_NAME ".Manager"
+#define LOGIN1_SESSION		LOGIN1_NAME ".Session"
+#define SCREENSAVER_NAME	"org.mate.ScreenSaver"
+#define SCREENSAVER_PATH	"/org/mate/ScreenSaver"
+#define DBUS_PROPERTIES		"org.freedesktop.DBus.Properties"
+
+
+/*
+ * Process-wide session state: shared by all applet instances.
+ */
+static struct {
+	session_changed_t	changed;	/* State change callback. */
+	gboolean		started;	/* Watching. */
+	gboolean		active;		/* Last reported state. */
+	gboolean		locked;		/* logind LockedHint. */
+	gboolean		idle;		/* logind IdleHint. */
+	gboolean		screensaver;	/* Screensaver active. */
+}	session = { NULL, FALSE, TRUE, FALSE, FALSE, FALSE };
+
+
+/*
+ *  Recompute the session state and report a change.
+ */
+static void
+session_update(void)
+{
+	gboolean active = !session.locked && !session.idle &&
+			  !session.screensaver;
+
+	if (active == session.active)
+		return;
+
+	session.active = active;
+	g_debug("Session %s", active? "active": "inactive");
+	if (session.changed)
+		session.changed(active);
+}
+
+
+/*
+ *  Get the session hints from a logind session property dictionary.
+ */
+static void
+session_hints(GVariant *props)
+{
+	g_variant_lookup(props, "LockedHint", "b", &session.locked);
+	g_variant_lookup(props, "IdleHint", "b", &session.idle);
+	session_update();
+}
+
+
+/*
+ *  logind session properties changed.
+ */
+static void
+session_properties_changed(GDBusConnection *connection,
+			   const gchar *sender, const gchar *path,
+			   const gchar *interface, const gchar *signal,
+			   GVariant *parameters, gpointer user_data)
+{
+	GVariant *props;
+
+	(void) connection;
+	(void) sender;
+	(void) path;
+	(void) interface;
+	(void) signal;
+	(void) user_data;
+
+	props = g_variant_get_child_value(parameters, 1);
+	session_hints(props);
+	g_variant_unref(props);
+}
+
+
+/*
+ *  Initial logind session properties.
+ */
+static void
+session_properties(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GVariant *reply;
+	GVariant *props;
+
+	(void) user_data;
+
+	reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source),
+					      result, NULL);
+	if (!reply)
+		return;
+
+	props = g_variant_get_child_value(reply, 0);
+	session_hints(props);
+	g_variant_unref(props);
+	g_variant_unref(reply);
+}
+
+
+/*
+ *  Our logind session object path is known: watch its hints. The system
+ *   bus reference is kept for the signal subscription.
+ */
+static void
+session_found(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GDBusConnection *bus = G_DBUS_CONNECTION(source);
+	GVariant *reply;
+	const gchar *path;
+
+	(void) user_data;
+
+	reply = g_dbus_connection_call_finish(bus, result, NULL);
+	if (!reply) {
+		g_object_unref(bus);
+		return;
+	}
+
+	g_variant_get(reply, "(&o)", &path);
+	g_dbus_connection_signal_subscribe(bus, LOGIN1_NAME, DBUS_PROPERTIES,
+					   "PropertiesChanged", path,
+					   LOGIN1_SESSION,
+					   G_DBUS_SIGNAL_FLAGS_NONE,
+					   session_properties_changed,
+					   NULL, NULL);
+	g_dbus_connection_call(bus, LOGIN1_NAME, path, DBUS_PROPERTIES,
+			       "GetAll", g_variant_new("(s)", LOGIN1_SESSION),
+			       G_VARIANT_TYPE("(a{sv})"),
+			       G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+			       session_properties, NULL);
+	g_variant_unref(reply);
+}
+
+
+/*
+ *  Get the logind session object path from its identifier.
+ */
+static void
+session_lookup(GDBusConnection *bus, const gchar *id)
+{
+	g_dbus_connection_call(bus, LOGIN1_NAME, LOGIN1_PATH, LOGIN1_MANAGER,
+			       "GetSession", g_variant_new("(s)", id),
+			       G_VARIANT_TYPE("(o)"), G_DBUS_CALL_FLAGS_NONE,
+			       -1, NULL, session_found, NULL);
+}
+
+
+/*
+ *  Identifier of the session logind selects for us.
+ */
+static void
+session_auto(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GDBusConnection *bus = G_DBUS_CONNECTION(source);
+	GVariant *reply;
+	GVariant *id;
+
+	(void) user_data;
+
+	reply = g_dbus_connection_call_finish(bus, result, NULL);
+	if (!reply) {
+		g_object_unref(bus);
+		return;
+	}
+
+	g_variant_get(reply, "(v)", &id);
+	if (g_variant_is_of_type(id, G_VARIANT_TYPE_STRING))
+		session_lookup(bus, g_variant_get_string(id, NULL));
+	else
+		g_object_unref(bus);
+	g_variant_unref(id);
+	g_variant_unref(reply);
+}
+
+
+/*
+ *  System bus connected: look up our logind session. When started by
+ *   D-Bus activation, the applet is not part of the session: use the
+ *   session identifier inherited from it if any, else the one logind
+ *   selects (the user's display session).
+ */
+static void
+system_bus_ready(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GDBusConnection *bus = g_bus_get_finish(result, NULL);
+	const gchar *id = g_getenv("XDG_SESSION_ID");
+
+	(void) source;
+	(void) user_data;
+
+	if (!bus)
+		return;
+
+	if (id && *id)
+		session_lookup(bus, id);
+	else
+		g_dbus_connection_call(bus, LOGIN1_NAME, LOGIN1_AUTO,
+				       DBUS_PROPERTIES, "Get",
+				       g_variant_new("(ss)", LOGIN1_SESSION,
+						     "Id"),
+				       G_VARIANT_TYPE("(v)"),
+				       G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+				       session_auto, NULL);
+}
+
+
+/*
+ *  Screensaver state changed.
+ */
+static void
+screensaver_changed(GDBusConnection *connection,
+		    const gchar *sender, const gchar *path,
+		    const gchar *interface, const gchar *signal,
+		    GVariant *parameters, gpointer user_data)
+{
+	(void) connection;
+	(void) sender;
+	(void) path;
+	(void) interface;
+	(void) signal;
+	(void) user_data;
+
+	if (g_variant_is_of_type(parameters, G_VARIANT_TYPE("(b)"))) {
+		g_variant_get(parameters, "(b)", &session.screensaver);
+		session_update();
+	}
+}
+
+
+/*
+ *  Initial screensaver state.
+ */
+static void
+screensaver_state(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GVariant *reply;
+
+	(void) user_data;
+
+	reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source),
+					      result, NULL);
+	if (!reply)
+		return;
+
+	g_variant_get(reply, "(b)", &session.screensaver);
+	g_variant_unref(reply);
+	session_update();
+}
+
+
+/*
+ *  Session bus connected: watch the screensaver.
+ */
+static void
+session_bus_ready(GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	GDBusConnection *bus = g_bus_get_finish(result, NULL);
+
+	(void) source;
+	(void) user_data;
+
+	if (!bus)
+		return;
+
+	g_dbus_connection_signal_subscribe(bus, SCREENSAVER_NAME,
+					   SCREENSAVER_NAME, "ActiveChanged",
+					   SCREENSAVER_PATH, NULL,
+					   G_DBUS_SIGNAL_FLAGS_NONE,
+					   screensaver_changed, NULL, NULL);
+	g_dbus_connection_call(bus, SCREENSAVER_NAME, SCREENSAVER_PATH,
+				SCREENSAVER_NAME, "GetActive", NULL,
+				G_VARIANT_TYPE("(b)"),
+				G_DBUS_CALL_FLAGS_NO_AUTO_START, -1, NULL,
+				screensaver_state, NULL);
+}
+
+
+/*
+ *  Start watching the session state. Services that are not available
+ *   are simply ignored: the session is then considered active.
+ */
+void
+session_watch(session_changed_t changed)
+{
+	session.changed = changed;
+
+	if (session.started)
+		return;
+
+	session.started = TRUE;
+	g_bus_get(G_BUS_TYPE_SYSTEM, NULL, system_bus_ready, NULL);
+	g_bus_get(G_BUS_TYPE_SESSION, NULL, session_bus_ready, NULL);
+}
+
+
+/*
+ *  Current session state.
+ */
+gboolean
+session_active(void)
+{
+	return session.active;
+}
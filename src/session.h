@@ -0,0 +1,34 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Session state watcher: tells whether the user session is in use, i.e.
+ *  neither locked nor idle, from logind and screensaver D-Bus signals.
+ */
+
+#ifndef COMPA_SESSION_H
+#define COMPA_SESSION_H
+
+#include <glib.h>
+
+typedef void	(*session_changed_t)(gboolean active);
+
+extern void	session_watch(session_changed_t changed);
+extern gboolean	session_active(void);
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Built-in source check: each available source must yield a value that
+ *  the applet can record in its history and match against style rules,
+ *  i.e.: text starting with a number. Sources whose kernel files are
+ *  missing on this host are skipped.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <glib.h>
+
+#include "sources.h"
+#include "style.h"
+
+
+#define CHECK_SKIP	77		/* Test harness "skipped" status. */
+#define CHECK_DELAY	100000		/* Delay between samples (usec). */
+#define CHECK_RULES	"<0 negative; >=0 positive"
+
+
+int
+main(int argc, char **argv)
+{
+	compa_rules_t *rules;
+	gint checked = 0;
+	gint failures = 0;
+	gint type;
+
+	(void) argc;
+	(void) argv;
+
+	rules = rules_new(CHECK_RULES, NULL);
+
+	for (type = SOURCE_COMMAND + 1; type < SOURCE_FILE; type++) {
+		compa_source_t *s = source_new(type, NULL);
+		gchar *text;
+		gdouble value;
+
+		if (!s)
+			continue;
+
+		/* Rates need a previous sample. */
+		g_free(source_read(s));
+		g_usleep(CHECK_DELAY);
+		text = source_read(s);
+		source_free(s);
+
+		if (!text) {
+			printf("source %d: unavailable\n", type);
+			continue;
+		}
+
+		checked++;
+		if (!text_number(text, &value) || !rules_match(rules, text)) {
+			printf("source %d: \"%s\": no value\n", type, text);
+			failures++;
+		}
+		else
+			printf("source %d: \"%s\": %g\n", type, text, value);
+		g_free(text);
+	}
+
+	rules_free(rules);
+
+	if (!checked)
+		return CHECK_SKIP;
+	return failures? 1: 0;
+}
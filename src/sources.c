@@ -0,0 +1,536 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glib.h>
+
+#include "sources.h"
+
+
+#define SOURCE_MAX_FILES	2	/* Max. files per source. */
+#define SOURCE_BUFFER_SIZE	8192	/* Initial file read buffer size. */
+#define SECTOR_SIZE		512	/* /proc/diskstats sector size. */
+
+
+/*
+ * A source provider.
+ */
+typedef struct {
+	const char *		scan;		/* Default device directory. */
+	const char *		prefix;		/* Default device name prefix. */
+	const char *		files[SOURCE_MAX_FILES]; /* %s is device. */
+	gchar *			(*read)(compa_source_t *s);
+}		source_class_t;
+
+struct compa_source {
+	const source_class_t *	class;
+	gchar *			device;		/* Selected device or NULL. */
+	gchar *			paths[SOURCE_MAX_FILES];
+	gint			fds[SOURCE_MAX_FILES];
+	gchar *			buf;		/* File read buffer. */
+	gsize			bufsize;	/* Its allocated size. */
+	gboolean		primed;		/* Previous sample valid. */
+	gint64			time;		/* Previous sample time. */
+	guint64			prev[2];	/* Previous counters. */
+	GHashTable *		disks;		/* Whole disk names cache. */
+};
+
+
+/*
+ *  Read a whole kernel file: the descriptor is kept open and re-read from
+ *   its beginning at each call.
+ */
+static const gchar *
+source_file(compa_source_t *s, gint i)
+{
+	gsize total = 0;
+	ssize_t len;
+
+	if (!s->paths[i])
+		return NULL;		/* No such device. */
+
+	if (s->fds[i] < 0) {
+		s->fds[i] = open(s->paths[i], O_RDONLY | O_CLOEXEC);
+		if (s->fds[i] < 0)
+			return NULL;
+	}
+
+	/* Read until end of file, growing the buffer as needed: it is kept
+	   for next calls. */
+	for (;;) {
+		if (s->bufsize - total <= 1) {
+			s->bufsize *= 2;
+			s->buf = g_realloc(s->buf, s->bufsize);
+		}
+		len = pread(s->fds[i], s->buf + total,
+			    s->bufsize - total - 1, total);
+		if (len > 0)
+			total += len;
+		else if (!len)
+			break;
+		else if (errno != EINTR) {
+			/* Device may have gone: reopen at next read. */
+			close(s->fds[i]);
+			s->fds[i] = -1;
+			return NULL;
+		}
+	}
+
+	s->buf[total] = '\0';
+	return s->buf;
+}
+
+
+/*
+ *  Format a byte rate.
+ */
+static void
+format_rate(GString *str, gdouble rate)
+{
+	static const char units[] = "BKMGT";
+	const char *u = units;
+
+	while (rate >= 1000 && u[1]) {
+		rate /= 1024;
+		u++;
+	}
+
+	g_string_append_printf(str, rate < 10? "%.1f%c/s": "%.0f%c/s",
+			       rate, *u);
+}
+
+
+/*
+ *  Compute rates from two cumulative counters.
+ */
+static gboolean
+source_rates(compa_source_t *s, guint64 a, guint64 b,
+	     gdouble *ra, gdouble *rb)
+{
+	gint64 now = g_get_monotonic_time();
+	gboolean primed = s->primed;
+	gdouble elapsed = (now - s->time) / (gdouble) G_USEC_PER_SEC;
+
+	if (primed && elapsed > 0) {
+		*ra = a >= s->prev[0]? (a - s->prev[0]) / elapsed: 0;
+		*rb = b >= s->prev[1]? (b - s->prev[1]) / elapsed: 0;
+	}
+
+	s->prev[0] = a;
+	s->prev[1] = b;
+	s->time = now;
+	s->primed = TRUE;
+	return primed && elapsed > 0;
+}
+
+
+/*
+ *  CPU usage from /proc/stat.
+ */
+static gchar *
+read_cpu(compa_source_t *s)
+{
+	const gchar *data = source_file(s, 0);
+	guint64 v[8] = { 0 };
+	guint64 total = 0;
+	guint64 idle;
+	guint64 dtotal;
+	gchar *p;
+	gint i;
+
+	if (!data || strncmp(data, "cpu ", 4))
+		return NULL;
+
+	for (p = (gchar *) data + 4, i = 0; i < G_N_ELEMENTS(v); i++) {
+		v[i] = g_ascii_strtoull(p, &p, 10);
+		total += v[i];
+	}
+
+	idle = v[3] + v[4];		/* idle + iowait. */
+	dtotal = s->primed? total - s->prev[0]: total;
+	if (s->primed)
+		idle -= s->prev[1];
+
+	s->prev[0] = total;
+	s->prev[1] = v[3] + v[4];
+	s->primed = TRUE;
+
+	return g_strdup_printf("CPU %u%%", dtotal?
+			       (guint) (100 * (dtotal - idle) / dtotal): 0);
+}
+
+
+/*
+ *  Get a /proc/meminfo value in kB.
+ */
+static guint64
+meminfo(const gchar *data, const gchar *key)
+{
+	const gchar *p = strstr(data, key);
+
+	return p? g_ascii_strtoull(p + strlen(key), NULL, 10): 0;
+}
+
+
+/*
+ *  Memory usage from /proc/meminfo.
+ */
+static gchar *
+read_memory(compa_source_t *s)
+{
+	const gchar *data = source_file(s, 0);
+	guint64 total;
+	guint64 available;
+
+	if (!data)
+		return NULL;
+
+	total = meminfo(data, "MemTotal:");
+	available = meminfo(data, "MemAvailable:");
+	if (!total || available > total)
+		return NULL;
+
+	return g_strdup_printf("Mem %u%%",
+			       (guint) (100 * (total - available) / total));
+}
+
+
+/*
+ *  Load average from /proc/loadavg.
+ */
+static gchar *
+read_load(compa_source_t *s)
+{
+	const gchar *data = source_file(s, 0);
+	gchar **fields;
+	gchar *text;
+
+	if (!data)
+		return NULL;
+
+	fields = g_strsplit(data, " ", 4);
+	text = g_strv_length(fields) < 4? NULL:
+	       g_strjoin(" ", fields[0], fields[1], fields[2], NULL);
+	g_strfreev(fields);
+	return text;
+}
+
+
+/*
+ *  Network throughput from /proc/net/dev.
+ */
+static gchar *
+read_network(compa_source_t *s)
+{
+	const gchar *data = source_file(s, 0);
+	guint64 rx = 0;
+	guint64 tx = 0;
+	gdouble rrx;
+	gdouble rtx;
+	GString *text;
+	gchar **lines;
+	gint i;
+
+	if (!data)
+		return NULL;
+
+	/* Skip the 2 header lines. */
+	lines = g_strsplit(data, "\n", -1);
+	for (i = 2; lines[i] && lines[i][0]; i++) {
+		gchar *name = g_strstrip(lines[i]);
+		gchar *p = strchr(name, ':');
+		gint j;
+
+		if (!p)
+			continue;
+
+		*p++ = '\0';
+		if (s->device? strcmp(name, s->device): !strcmp(name, "lo"))
+			continue;
+
+		/* Received bytes, 7 other fields, transmitted bytes. */
+		rx += g_ascii_strtoull(p, &p, 10);
+		for (j = 0; j < 7; j++)
+			g_ascii_strtoull(p, &p, 10);
+		tx += g_ascii_strtoull(p, &p, 10);
+	}
+	g_strfreev(lines);
+
+	if (!source_rates(s, rx, tx, &rrx, &rtx))
+		rrx = rtx = 0;
+
+	text = g_string_new("\xE2\x86\x93");		/* Down arrow. */
+	format_rate(text, rrx);
+	g_string_append(text, " \xE2\x86\x91");		/* Up arrow. */
+	format_rate(text, rtx);
+	return g_string_free(text, FALSE);
+}
+
+
+/*
+ *  Whether a /proc/diskstats entry is a whole disk. Answers are cached
+ *   to avoid file system lookups at each read.
+ */
+static gboolean
+whole_disk(compa_source_t *s, const gchar *name)
+{
+	gpointer cached;
+	gchar *path;
+	gboolean result;
+
+	if (!s->disks)
+		s->disks = g_hash_table_new_full(g_str_hash, g_str_equal,
+						 g_free, NULL);
+
+	cached = g_hash_table_lookup(s->disks, name);
+	if (cached)
+		return GPOINTER_TO_INT(cached) - 1;
+
+	path = g_strdup_printf("/sys/block/%s", name);
+	result = !g_str_has_prefix(name, "loop") &&
+		 !g_str_has_prefix(name, "ram") &&
+		 g_file_test(path, G_FILE_TEST_IS_DIR);
+	g_free(path);
+	g_hash_table_insert(s->disks, g_strdup(name),
+			    GINT_TO_POINTER(result + 1));
+	return result;
+}
+
+
+/*
+ *  Disk throughput from /proc/diskstats.
+ */
+static gchar *
+read_disk(compa_source_t *s)
+{
+	const gchar *data = source_file(s, 0);
+	guint64 rd = 0;
+	guint64 wr = 0;
+	gdouble rrd;
+	gdouble rwr;
+	GString *text;
+
+	if (!data)
+		return NULL;
+
+	for (; *data; data = strchr(data, '\n')? strchr(data, '\n') + 1: "") {
+		gchar name[64];
+		guint64 r;
+		guint64 w;
+
+		/* major minor name reads merged sectors ms writes merged
+		   sectors ... */
+		if (sscanf(data, "%*u %*u %63s %*u %*u %" G_GUINT64_FORMAT
+			   " %*u %*u %*u %" G_GUINT64_FORMAT,
+			   name, &r, &w) == 3 &&
+		    (s->device? !strcmp(name, s->device):
+				whole_disk(s, name))) {
+			rd += r;
+			wr += w;
+		}
+	}
+
+	if (!source_rates(s, rd * SECTOR_SIZE, wr * SECTOR_SIZE, &rrd, &rwr))
+		rrd = rwr = 0;
+
+	text = g_string_new("R ");
+	format_rate(text, rrd);
+	g_string_append(text, " W ");
+	format_rate(text, rwr);
+	return g_string_free(text, FALSE);
+}
+
+
+/*
+ *  Temperature from a thermal zone.
+ */
+static gchar *
+read_thermal(compa_source_t *s)
+{
+	const gchar *data = source_file(s, 0);
+
+	if (!data)
+		return NULL;
+
+	return g_strdup_printf("%.1f\xC2\xB0" "C",		/* Degree sign. */
+			       g_ascii_strtoll(data, NULL, 10) / 1000.0);
+}
+
+
+/*
+ *  Battery charge and status from the power supply class.
+ */
+static gchar *
+read_battery(compa_source_t *s)
+{
+	const gchar *data = source_file(s, 0);
+	guint capacity;
+
+	if (!data)
+		return NULL;
+
+	capacity = g_ascii_strtoull(data, NULL, 10);
+	data = source_file(s, 1);
+	return g_strdup_printf("%u%% %s", capacity,
+			       data? g_strstrip((gchar *) data): "");
+}
+
+
+static const source_class_t	classes[] = {
+	[SOURCE_CPU] = {
+		NULL, NULL, { "/proc/stat" }, read_cpu
+	},
+	[SOURCE_MEMORY] = {
+		NULL, NULL, { "/proc/meminfo" }, read_memory
+	},
+	[SOURCE_LOAD] = {
+		NULL, NULL, { "/proc/loadavg" }, read_load
+	},
+	[SOURCE_NETWORK] = {
+		NULL, NULL, { "/proc/net/dev" }, read_network
+	},
+	[SOURCE_DISK] = {
+		NULL, NULL, { "/proc/diskstats" }, read_disk
+	},
+	[SOURCE_THERMAL] = {
+		"/sys/class/thermal", "thermal_zone",
+		{ "/sys/class/thermal/%s/temp" }, read_thermal
+	},
+	[SOURCE_BATTERY] = {
+		"/sys/class/power_supply", "BAT", {
+			"/sys/class/power_supply/%s/capacity",
+			"/sys/class/power_supply/%s/status"
+		}, read_battery
+	},
+};
+
+
+/*
+ *  Find the default device of a class: the first entry of its directory
+ *   named with its prefix and providing its first file. Return NULL if
+ *   none.
+ */
+static gchar *
+source_default_device(const source_class_t *class)
+{
+	GDir *dir = g_dir_open(class->scan, 0, NULL);
+	const gchar *name;
+	gchar *first = NULL;
+	gchar *path;
+
+	if (!dir)
+		return NULL;
+
+	while ((name = g_dir_read_name(dir))) {
+		if (!g_str_has_prefix(name, class->prefix))
+			continue;
+
+		/* Compare numbered names: shorter ones come first. */
+		if (first && (strlen(name) > strlen(first) ||
+			      (strlen(name) == strlen(first) &&
+			       strcmp(name, first) > 0)))
+			continue;
+
+		path = g_strdup_printf(class->files[0], name);
+		if (g_file_test(path, G_FILE_TEST_EXISTS)) {
+			g_free(first);
+			first = g_strdup(name);
+		}
+		g_free(path);
+	}
+
+	g_dir_close(dir);
+	return first;
+}
+
+
+/*
+ *  Create a built-in source. `device' selects a network interface, a
+ *   disk, a thermal zone or a battery: if empty, all interfaces or disks
+ *   are summed up and the first thermal zone or battery is used.
+ */
+compa_source_t *
+source_new(gint type, const gchar *device)
+{
+	compa_source_t *s;
+	gint i;
+
+	if (type <= SOURCE_COMMAND || type >= G_N_ELEMENTS(classes))
+		return NULL;
+
+	s = g_new0(compa_source_t, 1);
+	s->class = classes + type;
+	s->bufsize = SOURCE_BUFFER_SIZE;
+	s->buf = g_malloc(s->bufsize);
+
+	if (device && *device)
+		s->device = g_strdup(device);
+	else if (s->class->scan)
+		s->device = source_default_device(s->class);
+
+	/* Without a device, a device class source has no files. */
+	for (i = 0; i < SOURCE_MAX_FILES; i++) {
+		const char *file = s->class->files[i];
+
+		s->fds[i] = -1;
+		if (file && (s->device || !s->class->scan))
+			s->paths[i] = g_strdup_printf(file, s->device);
+	}
+
+	return s;
+}
+
+
+/*
+ *  Get the current source text, or NULL if unavailable.
+ */
+gchar *
+source_read(compa_source_t *source)
+{
+	return source->class->read(source);
+}
+
+
+/*
+ *  Release a source.
+ */
+void
+source_free(compa_source_t *source)
+{
+	gint i;
+
+	if (!source)
+		return;
+
+	for (i = 0; i < SOURCE_MAX_FILES; i++) {
+		if (source->fds[i] >= 0)
+			close(source->fds[i]);
+		g_free(source->paths[i]);
+	}
+
+	if (source->disks)
+		g_hash_table_destroy(source->disks);
+	g_free(source->device);
+	g_free(source->buf);
+	g_free(source);
+}
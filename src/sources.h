@@ -0,0 +1,46 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Built-in data sources: they read kernel files directly instead of
+ *  spawning a command.
+ */
+
+#ifndef COMPA_SOURCES_H
+#define COMPA_SOURCES_H
+
+#include <glib.h>
+
+/* Source types: values of the monitor-source setting. */
+#define SOURCE_COMMAND		0	/* Not built-in: monitor command. */
+#define SOURCE_CPU		1	/* CPU usage. */
+#define SOURCE_MEMORY		2	/* Memory usage. */
+#define SOURCE_LOAD		3	/* Load average. */
+#define SOURCE_NETWORK		4	/* Network throughput. */
+#define SOURCE_DISK		5	/* Disk throughput. */
+#define SOURCE_THERMAL		6	/* Thermal zone temperature. */
+#define SOURCE_BATTERY		7	/* Battery charge. */
+#define SOURCE_FILE		8	/* Not built-in: watched file (watch.h). */
+
+typedef struct compa_source	compa_source_t;
+
+extern compa_source_t *	source_new(gint type, const gchar *device);
+extern gchar *		source_read(compa_source_t *source);
+extern void		source_free(compa_source_t *source);
+
+#endif
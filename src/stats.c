@@ -0,0 +1,228 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <libintl.h>
+#include <gio/gio.h>
+
+#include "config.h"
+#include "stats.h"
+
+#define _(s)	dgettext(PACKAGE_NAME, s)
+
+#define STATS_PATH		"/org/mate/panel/applet/compa/Instance%u"
+#define STATS_INTERFACE		"org.mate.panel.applet.compa.Statistics"
+
+
+static const guint64	bounds[STATS_BUCKETS - 1] = { STATS_BUCKET_BOUNDS };
+
+static const gchar	introspection[] =
+	"<node>"
+	"  <interface name='" STATS_INTERFACE "'>"
+	"    <property name='Command' type='s' access='read'/>"
+	"    <property name='Spawns' type='t' access='read'/>"
+	"    <property name='Failures' type='t' access='read'/>"
+	"    <property name='Timeouts' type='t' access='read'/>"
+	"    <property name='Skipped' type='t' access='read'/>"
+	"    <property name='BytesRead' type='t' access='read'/>"
+	"    <property name='LatencyBounds' type='at' access='read'/>"
+	"    <property name='MonitorLatency' type='at' access='read'/>"
+	"    <property name='TooltipLatency' type='at' access='read'/>"
+	"  </interface>"
+	"</node>";
+
+
+/*
+ *  Exported statistics.
+ */
+typedef struct {
+	compa_stats_t *		stats;
+	gchar **		command;	/* Monitor command variable. */
+}		stats_object_t;
+
+
+/*
+ *  Count a latency from `start' (monotonic usec) to now.
+ */
+void
+stats_latency(guint64 *histogram, gint64 start)
+{
+	guint64 ms = (g_get_monotonic_time() - start) / 1000;
+	gint i;
+
+	for (i = 0; i < STATS_BUCKETS - 1 && ms > bounds[i]; i++)
+		;
+	histogram[i]++;
+}
+
+
+/*
+ *  Append a latency histogram to a string.
+ */
+static void
+format_histogram(GString *s, const gchar *title, const guint64 *histogram)
+{
+	gint i;
+
+	g_string_append_printf(s, "\n%s", title);
+	for (i = 0; i < STATS_BUCKETS - 1; i++)
+		g_string_append_printf(s, "\n  \xE2\x89\xA4 %" G_GUINT64_FORMAT
+				       " ms: %" G_GUINT64_FORMAT,
+				       bounds[i], histogram[i]);
+	g_string_append_printf(s, "\n  > %" G_GUINT64_FORMAT
+			       " ms: %" G_GUINT64_FORMAT, bounds[i - 1],
+			       histogram[i]);
+}
+
+
+/*
+ *  Human readable statistics.
+ */
+gchar *
+stats_format(const compa_stats_t *stats)
+{
+	GString *s = g_string_new(NULL);
+	const struct {
+		const gchar *	label;
+		guint64		value;
+	} counters[] = {
+		{ _("Commands spawned:"),		stats->spawns	},
+		{ _("Failures:"),			stats->failures	},
+		{ _("Timeouts:"),			stats->timeouts	},
+		{ _("Unchanged updates skipped:"),	stats->skipped	},
+		{ _("Bytes read:"),			stats->bytes	},
+	};
+	gsize i;
+
+	for (i = 0; i < G_N_ELEMENTS(counters); i++)
+		g_string_append_printf(s, "%s%s %" G_GUINT64_FORMAT,
+				       i? "\n": "", counters[i].label,
+				       counters[i].value);
+	format_histogram(s, _("Monitor latency:"), stats->monitor_latency);
+	format_histogram(s, _("Tooltip latency:"), stats->tooltip_latency);
+	return g_string_free(s, FALSE);
+}
+
+
+/*
+ *  Build an histogram variant.
+ */
+static GVariant *
+histogram_variant(const guint64 *values, gint count)
+{
+	return g_variant_new_fixed_array(G_VARIANT_TYPE_UINT64, values,
+					 count, sizeof *values);
+}
+
+
+/*
+ *  D-Bus property getter.
+ */
+static GVariant *
+stats_get_property(GDBusConnection *connection, const gchar *sender,
+		   const gchar *path, const gchar *interface,
+		   const gchar *property, GError **error, gpointer user_data)
+{
+	stats_object_t *o = user_data;
+	compa_stats_t *stats = o->stats;
+
+	(void) connection;
+	(void) sender;
+	(void) path;
+	(void) interface;
+	(void) error;
+
+	if (!strcmp(property, "Command"))
+		return g_variant_new_string(*o->command? *o->command: "");
+	if (!strcmp(property, "Spawns"))
+		return g_variant_new_uint64(stats->spawns);
+	if (!strcmp(property, "Failures"))
+		return g_variant_new_uint64(stats->failures);
+	if (!strcmp(property, "Timeouts"))
+		return g_variant_new_uint64(stats->timeouts);
+	if (!strcmp(property, "Skipped"))
+		return g_variant_new_uint64(stats->skipped);
+	if (!strcmp(property, "BytesRead"))
+		return g_variant_new_uint64(stats->bytes);
+	if (!strcmp(property, "LatencyBounds"))
+		return histogram_variant(bounds, STATS_BUCKETS - 1);
+	if (!strcmp(property, "MonitorLatency"))
+		return histogram_variant(stats->monitor_latency,
+					 STATS_BUCKETS);
+	if (!strcmp(property, "TooltipLatency"))
+		return histogram_variant(stats->tooltip_latency,
+					 STATS_BUCKETS);
+	return NULL;
+}
+
+
+/*
+ *  Export statistics on the session bus. `command' points to the
+ *   variable holding the current monitor command, to identify the
+ *   instance. Returns a registration id or 0.
+ */
+guint
+stats_export(compa_stats_t *stats, gchar **command)
+{
+	static const GDBusInterfaceVTable vtable = {
+		NULL, stats_get_property, NULL
+	};
+	static GDBusNodeInfo *info;
+	static guint serial;
+	GDBusConnection *bus;
+	stats_object_t *o;
+	gchar *path;
+	guint id;
+
+	bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+	if (!bus)
+		return 0;
+
+	if (!info)
+		info = g_dbus_node_info_new_for_xml(introspection, NULL);
+
+	o = g_new(stats_object_t, 1);
+	o->stats = stats;
+	o->command = command;
+	path = g_strdup_printf(STATS_PATH, ++serial);
+	id = g_dbus_connection_register_object(bus, path,
+					       info->interfaces[0], &vtable,
+					       o, g_free, NULL);
+	g_free(path);
+	g_object_unref(bus);
+	return id;
+}
+
+
+/*
+ *  Withdraw exported statistics.
+ */
+void
+stats_unexport(guint registration)
+{
+	GDBusConnection *bus;
+
+	if (!registration)
+		return;
+
+	bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+	if (bus) {
+		g_dbus_connection_unregister_object(bus, registration);
+		g_object_unref(bus);
+	}
+}
@@ -0,0 +1,47 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Per-instance runtime statistics, also exported on the session bus.
+ */
+
+#ifndef COMPA_STATS_H
+#define COMPA_STATS_H
+
+#include <glib.h>
+
+/* Latency histogram buckets upper bounds (ms): the last one is unbound. */
+#define STATS_BUCKET_BOUNDS	10, 50, 100, 500, 1000, 5000
+#define STATS_BUCKETS		7
+
+typedef struct {
+	guint64			spawns;		/* Commands spawned. */
+	guint64			failures;	/* Spawn errors or exit != 0. */
+	guint64			timeouts;	/* Commands killed by timeout. */
+	guint64			skipped;	/* Unchanged updates skipped. */
+	guint64			bytes;		/* Command output bytes read. */
+	guint64			monitor_latency[STATS_BUCKETS];
+	guint64			tooltip_latency[STATS_BUCKETS];
+}		compa_stats_t;
+
+extern void	stats_latency(guint64 *histogram, gint64 start);
+extern gchar *	stats_format(const compa_stats_t *stats);
+extern guint	stats_export(compa_stats_t *stats, gchar **command);
+extern void	stats_unexport(guint registration);
+
+#endif
@@ -0,0 +1,235 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Numeric threshold rules selecting a style class.
+ *
+ * A rule specification is a `;'-separated list of `OP VALUE CLASS'
+ *  rules, in which OP is one of <, <=, >, >=, = or !=. Rules are tried in
+ *  order against the first number of a text and the first matching one
+ *  gives the class. Example: ">80 critical; >50 warning; <=50 normal".
+ */
+
+#include <string.h>
+#include <libintl.h>
+
+#include <glib.h>
+
+#include "config.h"
+#include "style.h"
+
+#define _(s)	dgettext(PACKAGE_NAME, s)
+
+
+enum rule_op {
+	RULE_LT,
+	RULE_LE,
+	RULE_GT,
+	RULE_GE,
+	RULE_EQ,
+	RULE_NE
+};
+
+typedef struct {
+	enum rule_op	op;
+	gdouble		value;
+	gchar *		class;
+}		compa_rule_t;
+
+struct compa_rules {
+	guint		count;
+	compa_rule_t	rule[1];
+};
+
+
+/*
+ *  Parse a rule operator.
+ */
+static gboolean
+rule_op(const gchar **s, enum rule_op *op)
+{
+	static const struct {
+		const gchar *	name;
+		enum rule_op	op;
+	}		ops[] = {
+		/* Two-character operators first. */
+		{	"<=",	RULE_LE	},
+		{	">=",	RULE_GE	},
+		{	"!=",	RULE_NE	},
+		{	"<",	RULE_LT	},
+		{	">",	RULE_GT	},
+		{	"=",	RULE_EQ	},
+	};
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(ops); i++) {
+		gsize len = strlen(ops[i].name);
+
+		if (!strncmp(*s, ops[i].name, len)) {
+			*s += len;
+			*op = ops[i].op;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+
+/*
+ *  Parse a single rule.
+ */
+static gboolean
+rule_parse(const gchar *s, compa_rule_t *rule)
+{
+	const gchar *class;
+	gchar *end;
+
+	s += strspn(s, " \t");
+	if (!rule_op(&s, &rule->op))
+		return FALSE;
+	rule->value = g_ascii_strtod(s, &end);
+	if (end == s)
+		return FALSE;
+	s = end + strspn(end, " \t");
+	class = s;
+	s += strspn(s, "abcdefghijklmnopqrstuvwxyz"
+		       "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_");
+	if (s == class || s[strspn(s, " \t")])
+		return FALSE;
+	rule->class = g_strndup(class, s - class);
+	return TRUE;
+}
+
+
+/*
+ *  Compile a rule specification. An empty specification yields NULL
+ *   without error.
+ */
+compa_rules_t *
+rules_new(const gchar *spec, GError **error)
+{
+	compa_rules_t *rules;
+	gchar **items;
+	guint i;
+
+	items = g_strsplit(spec, ";", -1);
+	rules = g_malloc0(sizeof *rules +
+			  g_strv_length(items) * sizeof rules->rule[0]);
+
+	for (i = 0; items[i]; i++) {
+		if (!*g_strstrip(items[i]))
+			continue;
+		if (!rule_parse(items[i], rules->rule + rules->count)) {
+			g_set_error(error, G_MARKUP_ERROR,
+				    G_MARKUP_ERROR_INVALID_CONTENT,
+				    _("Invalid style rule \"%s\""), items[i]);
+			g_strfreev(items);
+			rules_free(rules);
+			return NULL;
+		}
+		rules->count++;
+	}
+
+	g_strfreev(items);
+	if (!rules->count) {
+		rules_free(rules);
+		rules = NULL;
+	}
+	return rules;
+}
+
+
+/*
+ *  Get the first number in text. Return FALSE if none.
+ */
+gboolean
+text_number(const gchar *text, gdouble *value)
+{
+	const gchar *s;
+
+	/* Locate the first digit, then include sign and leading point. */
+	for (s = text; *s && !g_ascii_isdigit(*s); s++)
+		;
+	if (!*s)
+		return FALSE;
+	if (s > text && s[-1] == '.')
+		s--;
+	if (s > text && s[-1] == '-')
+		s--;
+	*value = g_ascii_strtod(s, NULL);
+	return TRUE;
+}
+
+
+/*
+ *  Return the class selected by the first number in text, or NULL if
+ *   none.
+ */
+const gchar *
+rules_match(const compa_rules_t *rules, const gchar *text)
+{
+	const compa_rule_t *rule;
+	gdouble value;
+
+	if (!text_number(text, &value))
+		return NULL;
+
+	for (rule = rules->rule; rule < rules->rule + rules->count; rule++) {
+		gboolean match = FALSE;
+
+		switch (rule->op) {
+		case RULE_LT:
+			match = value < rule->value;
+			break;
+		case RULE_LE:
+			match = value <= rule->value;
+			break;
+		case RULE_GT:
+			match = value > rule->value;
+			break;
+		case RULE_GE:
+			match = value >= rule->value;
+			break;
+		case RULE_EQ:
+			match = value == rule->value;
+			break;
+		case RULE_NE:
+			match = value != rule->value;
+			break;
+		}
+		if (match)
+			return rule->class;
+	}
+	return NULL;
+}
+
+
+/*
+ *  Release compiled rules.
+ */
+void
+rules_free(compa_rules_t *rules)
+{
+	guint i;
+
+	if (rules) {
+		for (i = 0; i < rules->count; i++)
+			g_free(rules->rule[i].class);
+		g_free(rules);
+	}
+}
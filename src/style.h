@@ -0,0 +1,37 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Numeric threshold rules selecting a style class.
+ */
+
+#ifndef COMPA_STYLE_H
+#define COMPA_STYLE_H
+
+#include <glib.h>
+
+typedef struct compa_rules	compa_rules_t;
+
+extern compa_rules_t *
+		rules_new(const gchar *spec, GError **error);
+extern const gchar *
+		rules_match(const compa_rules_t *rules, const gchar *text);
+extern void	rules_free(compa_rules_t *rules);
+extern gboolean	text_number(const gchar *text, gdouble *value);
+
+#endif
@@ -0,0 +1,287 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Event-driven data source: a watched file or FIFO.
+ *
+ * A regular file is monitored with GFileMonitor and read again when it
+ *  is rewritten, replaced or deleted. Each line written to a FIFO is a
+ *  record. Bursts of events are coalesced: the update procedure is called
+ *  at most once per debounce delay, with the latest data.
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <gio/gio.h>
+#include <glib-unix.h>
+
+#include "config.h"
+#include "run.h"
+#include "watch.h"
+
+#define WATCH_DEBOUNCE		100	/* Event coalescing delay (ms). */
+#define WATCH_READ_SIZE		4096	/* FIFO read chunk size. */
+#define WATCH_RECORD_MAX	65536	/* FIFO max. record size. */
+
+
+struct compa_watch {
+	gchar *			path;		/* Watched path. */
+	gsize			limit;		/* Data size limit. */
+	GFileMonitor *		monitor;	/* Regular file monitor. */
+	gint			fd;		/* FIFO descriptor or -1. */
+	guint			fd_watch;	/* FIFO input source. */
+	GString *		partial;	/* FIFO incomplete record. */
+	gchar *			record;		/* FIFO latest record. */
+	guint			timer;		/* Debounce timer. */
+	void			(*update)(const gchar *text, gpointer data);
+	gpointer		data;
+};
+
+
+/*
+ *  Read a regular file: no more than one byte past the size limit is
+ *   read, to detect truncation.
+ */
+static gchar *
+watch_read(compa_watch_t *w)
+{
+	GString *text = g_string_new(NULL);
+	gsize start;
+	gssize len;
+	gint fd;
+
+	fd = open(w->path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	do {
+		start = text->len;
+		g_string_set_size(text, start + MIN(WATCH_READ_SIZE,
+						    w->limit + 1 - start));
+		len = read(fd, text->str + start, text->len - start);
+		g_string_truncate(text, start + MAX(len, 0));
+	} while (len > 0 && text->len <= w->limit);
+	close(fd);
+
+	if (len < 0) {
+		g_string_free(text, TRUE);
+		return NULL;
+	}
+	return g_string_free(text, FALSE);
+}
+
+
+/*
+ *  Debounce delay expired: deliver the current data, truncated to the
+ *   size limit like command output.
+ */
+static gboolean
+watch_deliver(gpointer user_data)
+{
+	compa_watch_t *w = user_data;
+	gchar *text = NULL;
+	gsize cut;
+
+	w->timer = 0;
+
+	if (w->fd >= 0) {
+		text = w->record;
+		w->record = NULL;
+	}
+	else
+		text = watch_read(w);
+
+	if (text) {
+		g_strchomp(text);
+		if (strlen(text) > w->limit) {
+			/* Do not split an UTF-8 character. */
+			for (cut = w->limit; cut && (text[cut] & 0xC0) == 0x80;)
+				cut--;
+			text[cut] = '\0';
+			text = g_realloc(text, cut + sizeof OUTPUT_MARKER);
+			strcpy(text + cut, OUTPUT_MARKER);
+		}
+	}
+	w->update(text, w->data);
+	g_free(text);
+	return G_SOURCE_REMOVE;
+}
+
+
+/*
+ *  Schedule a delivery, unless one is already pending.
+ */
+static void
+watch_schedule(compa_watch_t *w)
+{
+	if (!w->timer)
+		w->timer = g_timeout_add(WATCH_DEBOUNCE, watch_deliver, w);
+}
+
+
+/*
+ *  Regular file event.
+ */
+static void
+watch_changed(GFileMonitor *monitor, GFile *file, GFile *other,
+	      GFileMonitorEvent event, gpointer user_data)
+{
+	(void) monitor;
+	(void) file;
+	(void) other;
+
+	switch (event) {
+	case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
+	case G_FILE_MONITOR_EVENT_PRE_UNMOUNT:
+	case G_FILE_MONITOR_EVENT_UNMOUNTED:
+		break;
+
+	default:
+		watch_schedule(user_data);
+		break;
+	}
+}
+
+
+/*
+ *  FIFO input: keep the latest complete record.
+ */
+static gboolean
+watch_input(gint fd, GIOCondition condition, gpointer user_data)
+{
+	compa_watch_t *w = user_data;
+	GString *buf = w->partial;
+	gsize start;
+	gsize end;
+	gssize len;
+
+	(void) condition;
+
+	for (;;) {
+		start = buf->len;
+		g_string_set_size(buf, start + WATCH_READ_SIZE);
+		len = read(fd, buf->str + start, WATCH_READ_SIZE);
+		g_string_truncate(buf, start + MAX(len, 0));
+		if (len <= 0)
+			break;
+	}
+
+	/* Locate the last complete record. */
+	for (end = buf->len; end && buf->str[end - 1] != '\n'; end--)
+		;
+	if (end) {
+		for (start = end - 1; start && buf->str[start - 1] != '\n';)
+			start--;
+		g_free(w->record);
+		w->record = g_strndup(buf->str + start, end - 1 - start);
+		g_string_erase(buf, 0, end);
+		watch_schedule(w);
+	}
+	else if (buf->len > WATCH_RECORD_MAX)
+		g_string_truncate(buf, 0);	/* Not a line-oriented FIFO. */
+
+	return G_SOURCE_CONTINUE;
+}
+
+
+/*
+ *  Start watching a path. A regular file is read immediately. Delivered
+ *   data are limited to `limit' bytes.
+ */
+compa_watch_t *
+watch_new(const gchar *path, gsize limit,
+	  void (*update)(const gchar *text, gpointer data), gpointer data)
+{
+	compa_watch_t *w;
+	struct stat st;
+	GFile *file;
+
+	if (!path || !*path)
+		return NULL;
+
+	w = g_new0(compa_watch_t, 1);
+	w->path = g_strdup(path);
+	w->limit = MAX(limit, OUTPUT_LIMIT_MIN);
+	w->fd = -1;
+	w->update = update;
+	w->data = data;
+
+	if (!stat(path, &st) && S_ISFIFO(st.st_mode)) {
+		/* Opened read-write so that it never reaches end of file
+		   when writers close. */
+		w->fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+		if (w->fd >= 0) {
+			w->partial = g_string_new(NULL);
+			w->fd_watch = g_unix_fd_add(w->fd, G_IO_IN,
+						    watch_input, w);
+			return w;
+		}
+	}
+
+	file = g_file_new_for_path(path);
+	w->monitor = g_file_monitor_file(file, G_FILE_MONITOR_WATCH_MOVES,
+					 NULL, NULL);
+	g_object_unref(file);
+	if (w->monitor)
+		g_signal_connect(w->monitor, "changed",
+				 G_CALLBACK(watch_changed), w);
+	watch_schedule(w);
+	return w;
+}
+
+
+/*
+ *  Read a regular file again. Nothing to do for a FIFO: records are
+ *   delivered as they arrive.
+ */
+void
+watch_refresh(compa_watch_t *watch)
+{
+	if (watch->fd < 0)
+		watch_schedule(watch);
+}
+
+
+/*
+ *  Stop watching.
+ */
+void
+watch_free(compa_watch_t *watch)
+{
+	if (!watch)
+		return;
+
+	if (watch->timer)
+		g_source_remove(watch->timer);
+	if (watch->monitor) {
+		g_file_monitor_cancel(watch->monitor);
+		g_object_unref(watch->monitor);
+	}
+	if (watch->fd_watch)
+		g_source_remove(watch->fd_watch);
+	if (watch->fd >= 0)
+		close(watch->fd);
+	if (watch->partial)
+		g_string_free(watch->partial, TRUE);
+	g_free(watch->record);
+	g_free(watch->path);
+	g_free(watch);
+}
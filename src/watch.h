@@ -0,0 +1,37 @@
+/*
+ * compa - Command Output Monitor Panel Applet
+ * Copyright (C) 2015-2022 Patrick Monnerat <patrick@monnerat.net>
+ *
+ * compa is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * compa is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Event-driven data source: a watched file or FIFO.
+ */
+
+#ifndef COMPA_WATCH_H
+#define COMPA_WATCH_H
+
+#include <glib.h>
+
+typedef struct compa_watch	compa_watch_t;
+
+extern compa_watch_t *	watch_new(const gchar *path, gsize limit,
+				  void (*update)(const gchar *text,
+						 gpointer data),
+				  gpointer data);
+extern void		watch_refresh(compa_watch_t *watch);
+extern void		watch_free(compa_watch_t *watch);
+
+#endif